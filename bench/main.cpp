@@ -0,0 +1,263 @@
+#include "argument_parser/lib/parser.h"
+#include "lib/hamarc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <tuple>
+#include <variant>
+
+/* ex. run commands:
+ * -o bench.json
+ * -o bench.json -d /tmp/hamarc_bench -s 64 -n 200 -H 1024 -j 8 -w 57
+ * -o bench.json -n 0 -H 4096 -q 16 -B 8
+ *
+ * Codec: encode and decode of every word (word lengths and aligned profiles) on random data in memory.
+ * Archive: create, list, extract, append, delete and concatenate of Haf with many small files and with a few huge
+ * files, generated in work directory. Results are written as JSON, messages of Haf operations are dropped
+ */
+struct Arguments {
+    supported_variants output = "hamarc_bench.json";
+    supported_variants work_directory = "";
+    // Random data coded for every word in MiB
+    supported_variants codec_size = 16;
+    // The best of repeats is taken
+    supported_variants repeats = 3;
+    supported_variants small_files = 1000;
+    // Size of small files in KiB
+    supported_variants small_size = 16;
+    supported_variants huge_files = 2;
+    // Size of huge files in MiB
+    supported_variants huge_size = 256;
+    supported_variants word_coding_length = std::to_string(DEFAULT_LENGTH);
+    supported_variants threads = 1;
+    supported_variants queue_depth = DEFAULT_IO_QUEUE_DEPTH;
+    supported_variants io_buffers = DEFAULT_IO_BUFFERS;
+    std::vector<std::string> free_args;
+};
+
+auto arguments = new Arguments{};
+
+void ParseLocal(int argc, char** argv) {
+    std::vector<std::tuple<supported_variants&, std::string, std::string>> parameters =
+        {{arguments->output,             "-o", "--output"},
+         {arguments->work_directory,     "-d", "--dir"},
+         {arguments->codec_size,         "-s", "--codec-size"},
+         {arguments->repeats,            "-r", "--repeats"},
+         {arguments->small_files,        "-n", "--small-files"},
+         {arguments->small_size,         "-k", "--small-size"},
+         {arguments->huge_files,         "-N", "--huge-files"},
+         {arguments->huge_size,          "-H", "--huge-size"},
+         {arguments->word_coding_length, "-w", "--word"},
+         {arguments->threads,            "-j", "--jobs"},
+         {arguments->queue_depth,        "-q", "--queue-depth"},
+         {arguments->io_buffers,         "-B", "--buffers"}};
+    Parse(argc, argv, parameters, arguments->free_args);
+}
+
+namespace {
+
+double Seconds(const std::function<void()>& run) {
+    auto begin = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+double BestSeconds(int repeats, const std::function<void()>& run) {
+    double best = Seconds(run);
+    for (int i = 1; i < repeats; i++) {
+        best = std::min(best, Seconds(run));
+    }
+    return best;
+}
+
+double MegabytesPerSecond(uint64_t bytes, double seconds) {
+    return seconds > 0 ? bytes / seconds / 1e6 : 0;
+}
+
+void FillRandom(std::vector<char>& data, std::mt19937_64& random) {
+    for (size_t i = 0; i + sizeof(uint64_t) <= data.size(); i += sizeof(uint64_t)) {
+        uint64_t value = random();
+        std::memcpy(data.data() + i, &value, sizeof(value));
+    }
+}
+
+struct CodecResult {
+    uint16_t word;
+    double encode_seconds;
+    double decode_seconds;
+    uint64_t bytes;
+    uint64_t codewords;
+};
+
+// Whole groups of codewords of data_size bytes, so both directions are pure codec without carries
+CodecResult BenchCodec(uint16_t word, uint64_t data_size, int repeats, std::mt19937_64& random) {
+    const auto& code = GetHammingCode(word);
+    uint64_t groups = std::max<uint64_t>(1, data_size / code.word);
+    std::vector<char> data(groups * code.word);
+    FillRandom(data, random);
+    std::vector<uint8_t> coded(groups * code.length);
+    std::vector<uint8_t> decoded(data.size());
+    const auto* input = reinterpret_cast<const uint8_t*>(data.data());
+    CodecResult result{word, 0, 0, data.size(), groups * CHAR_BIT};
+    result.encode_seconds = BestSeconds(repeats, [&]() {
+        EncodeCodewords(code, input, data.size(), result.codewords, coded.data());
+    });
+    result.decode_seconds = BestSeconds(repeats, [&]() {
+        DecodeCodewords(code, coded.data(), coded.size(), result.codewords, decoded.data());
+    });
+    if (!std::equal(decoded.begin(), decoded.end(), input))
+        throw std::logic_error("Decoded data differs for word " + WordName(word));
+    return result;
+}
+
+struct ArchiveResult {
+    std::string dataset;
+    std::string operation;
+    uint64_t files;
+    uint64_t bytes;
+    double seconds;
+};
+
+// Files of dataset are written to work/dataset/data, Haf and extracted files are in work/dataset/haf
+std::vector<std::string> MakeDataset(const std::filesystem::path& directory, uint64_t files, uint64_t size,
+                                     std::mt19937_64& random) {
+    std::filesystem::create_directories(directory);
+    std::vector<std::string> names;
+    std::vector<char> data(std::min<uint64_t>(size, 1 << 24));
+    for (uint64_t i = 0; i < files; i++) {
+        names.push_back((directory / ("file" + std::to_string(i) + ".bin")).string());
+        std::ofstream output(names.back(), std::ios::binary);
+        for (uint64_t written = 0; written < size; written += data.size()) {
+            FillRandom(data, random);
+            output.write(data.data(), (std::streamsize) std::min<uint64_t>(data.size(), size - written));
+        }
+    }
+    return names;
+}
+
+void BenchArchive(const std::string& dataset, const std::filesystem::path& work, uint64_t files, uint64_t size,
+                  uint16_t word_, unsigned threads, std::mt19937_64& random, std::vector<ArchiveResult>& results) {
+    std::cout << "Archive of " << dataset << ": " << files << " x " << size << "B\n";
+    auto names = MakeDataset(work / dataset / "data", files + 1, size, random);
+    std::string appended = names.back();
+    names.pop_back();
+    std::filesystem::create_directories(work / dataset / "haf");
+    const std::string haf = (work / dataset / "haf" / "bench.haf").string();
+    const std::string merged = (work / dataset / "haf" / "merged.haf").string();
+    const uint64_t bytes = files * size;
+
+    // Messages of Haf operations are not a part of results
+    auto measure = [&](const std::string& operation, uint64_t operation_files, uint64_t operation_bytes,
+                       const std::function<void()>& run) {
+        auto* output = std::cout.rdbuf(nullptr);
+        double seconds = Seconds(run);
+        std::cout.rdbuf(output);
+        std::cout.clear();
+        results.push_back({dataset, operation, operation_files, operation_bytes, seconds});
+        std::cout << "  " << operation << ": " << seconds << "s\n";
+    };
+    measure("create", files, bytes, [&]() { CreateHaf(haf, names, word_, "", threads); });
+    measure("list", files, bytes, [&]() { HafFilesList(haf); });
+    measure("extract", files, bytes, [&]() { ExtractHaf(haf, "", threads); });
+    std::vector<std::string> append_args = {appended};
+    measure("append", 1, size, [&]() { AppendFilesToHaf(haf, append_args); });
+    std::vector<std::string> delete_args = {IncludedFileName(names.front())};
+    measure("delete", 1, size, [&]() { DeleteFilesFromHaf(haf, delete_args); });
+    std::vector<std::string> parts = {haf, haf};
+    measure("concatenate", 2 * files, 2 * bytes, [&]() { ConcatenateHaf(merged, parts); });
+    std::filesystem::remove_all(work / dataset);
+}
+
+void WriteJson(std::ostream& output, const std::vector<CodecResult>& codec,
+               const std::vector<ArchiveResult>& archive, uint16_t word_, unsigned threads) {
+    output << "{\n";
+    output << "  \"kernel\": \"" << CodecKernelName(GetCodecKernel()) << "\",\n";
+    output << "  \"codec\": [\n";
+    for (size_t i = 0; i < codec.size(); i++) {
+        const auto& result = codec[i];
+        output << "    {\"word\": \"" << WordName(result.word) << "\", \"bytes\": " << result.bytes
+               << ", \"codewords\": " << result.codewords
+               << ", \"encode_mb_per_s\": " << MegabytesPerSecond(result.bytes, result.encode_seconds)
+               << ", \"decode_mb_per_s\": " << MegabytesPerSecond(result.bytes, result.decode_seconds)
+               << ", \"encode_ns_per_codeword\": " << result.encode_seconds * 1e9 / result.codewords
+               << ", \"decode_ns_per_codeword\": " << result.decode_seconds * 1e9 / result.codewords << "}"
+               << (i + 1 < codec.size() ? ",\n" : "\n");
+    }
+    output << "  ],\n";
+    output << "  \"archive_word\": \"" << WordName(word_) << "\",\n";
+    output << "  \"threads\": " << threads << ",\n";
+    output << "  \"queue_depth\": " << IoQueueDepth() << ",\n";
+    output << "  \"io_buffers\": " << IoBuffers() << ",\n";
+    output << "  \"archive\": [\n";
+    for (size_t i = 0; i < archive.size(); i++) {
+        const auto& result = archive[i];
+        output << "    {\"dataset\": \"" << result.dataset << "\", \"operation\": \"" << result.operation
+               << "\", \"files\": " << result.files << ", \"bytes\": " << result.bytes
+               << ", \"seconds\": " << result.seconds
+               << ", \"mb_per_s\": " << MegabytesPerSecond(result.bytes, result.seconds) << "}"
+               << (i + 1 < archive.size() ? ",\n" : "\n");
+    }
+    output << "  ]\n";
+    output << "}\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    ParseLocal(argc, argv);
+    const std::string output_filename = std::get<std::string>(arguments->output);
+    std::string work_directory = std::get<std::string>(arguments->work_directory);
+    int codec_size = std::get<int>(arguments->codec_size);
+    int repeats = std::max(std::get<int>(arguments->repeats), 1);
+    int small_files = std::max(std::get<int>(arguments->small_files), 0);
+    int small_size = std::max(std::get<int>(arguments->small_size), 0);
+    int huge_files = std::max(std::get<int>(arguments->huge_files), 0);
+    int huge_size = std::max(std::get<int>(arguments->huge_size), 0);
+    std::string word_coding_length = std::get<std::string>(arguments->word_coding_length);
+    auto threads = (unsigned) std::max(std::get<int>(arguments->threads), 1);
+    int queue_depth = std::get<int>(arguments->queue_depth);
+    int io_buffers = std::get<int>(arguments->io_buffers);
+    delete arguments;
+    if (work_directory.empty()) work_directory = (std::filesystem::temp_directory_path() / "hamarc_bench").string();
+
+    try {
+        uint16_t word_ = ParseWord(word_coding_length);
+        SetIoQueue(std::max(queue_depth, 0), std::max(io_buffers, 0));
+        std::mt19937_64 random(DEFAULT_LENGTH);
+        std::vector<CodecResult> codec;
+        std::cout << "Codec kernel: " << CodecKernelName(GetCodecKernel()) << "\n";
+        for (uint16_t word = 1; word <= SECDED_137_128; word++) {
+            if (!IsValidWord(word)) continue;
+            codec.push_back(BenchCodec(word, (uint64_t) std::max(codec_size, 1) << 20, repeats, random));
+            std::cout << "Word " << WordName(word) << ": encode "
+                      << MegabytesPerSecond(codec.back().bytes, codec.back().encode_seconds) << " MB/s, decode "
+                      << MegabytesPerSecond(codec.back().bytes, codec.back().decode_seconds) << " MB/s\n";
+        }
+
+        std::vector<ArchiveResult> archive;
+        if (small_files > 0)
+            BenchArchive("small_files", work_directory, small_files, (uint64_t) small_size << 10, word_, threads,
+                         random, archive);
+        if (huge_files > 0)
+            BenchArchive("huge_files", work_directory, huge_files, (uint64_t) huge_size << 20, word_, threads,
+                         random, archive);
+
+        std::ofstream output(output_filename);
+        WriteJson(output, codec, archive, word_, threads);
+        if (!output)
+            throw std::runtime_error("Failed to write " + output_filename);
+        std::cout << "Results are written to " << output_filename << "\n";
+    }
+    catch (const std::exception& ex) {
+        std::cerr << ex.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
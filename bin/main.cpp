@@ -1,16 +1,35 @@
 #include "argument_parser/lib/parser.h"
-#include "lib/bitstream.h"
+#include "lib/hamarc.h"
 
+#include <algorithm>
 #include <iostream>
+#include <optional>
 #include <tuple>
 #include <variant>
 
 /* ex. run commands:
  * -f=..\..\result_files\output\out_file1.haf -c ..\..\result_files\input\image.jpg ..\..\result_files\input\in2.txt -x -l -w 11
+ * -f=..\..\result_files\output\out_file1.haf -c ..\..\result_files\input\image.jpg -w 57 -j 8
+ * -f=..\..\result_files\output\out_file1.haf -c ..\..\result_files\input\image.jpg -w 57 -I
+ * -f=..\..\result_files\output\out_file1.haf -c ..\..\result_files\input\image.jpg -w 72,64 -j 8
+ * -f=..\..\result_files\output\out_file1.haf -x -b 8
+ * -f=..\..\result_files\output\out_file1.haf -c ..\..\result_files\input\image.jpg -q 16 -B 8
+ * -f=..\..\result_files\output\out_file6.haf -c ..\..\result_files\input -j 8
+ * -f=..\..\result_files\output\out_file6.haf -c ..\..\result_files\input -D
+ * -f=..\..\result_files\output\out_file7.haf -c ..\..\result_files\input -z -j 8
+ * -f=..\..\result_files\output\out_file8.haf -c ..\..\result_files\input -r 1e-15 -m optical
  * -f=..\..\result_files\output\out_file1.haf -a ..\..\result_files\input\in_file1_1.txt -l
  * -f=..\..\result_files\output\out_file1.haf -d image.jpg -l
+ * -f=..\..\result_files\output\out_file1.haf -d image.jpg -T
+ * -f=..\..\result_files\output\out_file1.haf -C -l
+ * -f=..\..\result_files\output\out_file1.haf -x in_file1_1.txt
+ * -f=/dev/stdout -c /dev/stdin ..\..\result_files\input\image.jpg > ..\..\result_files\output\out_file5.haf
+ * -f=/dev/stdin -x -O stdin < ..\..\result_files\output\out_file5.haf
  * -f=..\..\result_files\output\out_file2.haf -c ..\..\result_files\input\in_file1_1.txt -l
  * -f=..\..\result_files\output\out_file3.haf -c ..\..\result_files\input\image.jpg -l
+ * -f=..\..\result_files\output\out_file1.haf -t -w 57 -l
+ * -f=..\..\result_files\output\out_file1.haf -V -j 8
+ * -f=..\..\result_files\output\out_file1.haf -R -j 8
  * -f=..\..\result_files\output\out_file4.haf -A ..\..\result_files\output\out_file2.haf ..\..\result_files\output\out_file3.haf -l
  *
  */
@@ -19,10 +38,33 @@ struct Arguments {
     supported_variants create_command = false;
     supported_variants list_command = false;
     supported_variants extract_command = false;
+    supported_variants to_stdout = false;
     supported_variants append_command = false;
     supported_variants delete_command = false;
+    // Deleted files are only marked, their space is reclaimed by compact command
+    supported_variants tombstone = false;
+    supported_variants compact_command = false;
     supported_variants concatenate_command = false;
-    supported_variants word_coding_length = DEFAULT_LENGTH;
+    supported_variants transcode_command = false;
+    supported_variants verify_command = false;
+    supported_variants repair_command = false;
+    // Word length or aligned profile (72,64 or 137,128)
+    supported_variants word_coding_length = std::to_string(DEFAULT_LENGTH);
+    // Created or transcoded Haf gets interleaved layout of codewords
+    supported_variants interleave = false;
+    // Created Haf stores files with the same data once
+    supported_variants dedup = false;
+    // Created Haf stores files compressed if it makes them smaller
+    supported_variants compress = false;
+    // Created Haf gets words chosen for residual error rate on media (class or its bit error rate)
+    supported_variants error_rate = "";
+    supported_variants media = "hdd";
+    supported_variants threads = 1;
+    // Size of I/O buffers in MiB
+    supported_variants buffer_size = DEFAULT_IO_BUFFER_SIZE >> 20;
+    // Requests of background I/O in flight and buffers read ahead or written behind (1 is synchronous I/O)
+    supported_variants queue_depth = DEFAULT_IO_QUEUE_DEPTH;
+    supported_variants io_buffers = DEFAULT_IO_BUFFERS;
     std::vector<std::string> free_args;
 };
 
@@ -34,10 +76,25 @@ void ParseLocal(int argc, char** argv) {
          {arguments->create_command,      "-c", "--create"},
          {arguments->list_command,        "-l", "--list"},
          {arguments->extract_command,     "-x", "--extract"},
+         {arguments->to_stdout,           "-O", "--to-stdout"},
          {arguments->append_command,      "-a", "--append"},
          {arguments->delete_command,      "-d", "--delete"},
+         {arguments->tombstone,           "-T", "--tombstone"},
+         {arguments->compact_command,     "-C", "--compact"},
          {arguments->concatenate_command, "-A", "--concatenate"},
-         {arguments->word_coding_length,  "-w", "--word"}};
+         {arguments->transcode_command,   "-t", "--transcode"},
+         {arguments->verify_command,      "-V", "--verify"},
+         {arguments->repair_command,      "-R", "--repair"},
+         {arguments->word_coding_length,  "-w", "--word"},
+         {arguments->interleave,          "-I", "--interleave"},
+         {arguments->dedup,               "-D", "--dedup"},
+         {arguments->compress,            "-z", "--compress"},
+         {arguments->error_rate,          "-r", "--error-rate"},
+         {arguments->media,               "-m", "--media"},
+         {arguments->threads,             "-j", "--jobs"},
+         {arguments->buffer_size,         "-b", "--buffer"},
+         {arguments->queue_depth,         "-q", "--queue-depth"},
+         {arguments->io_buffers,          "-B", "--buffers"}};
     Parse(argc, argv, parameters, arguments->free_args);
 }
 
@@ -54,24 +111,50 @@ int main(int argc, char** argv) {
     bool create_command = std::get<bool>(arguments->create_command);
     bool list_command = std::get<bool>(arguments->list_command);
     bool extract_command = std::get<bool>(arguments->extract_command);
+    bool to_stdout = std::get<bool>(arguments->to_stdout);
     bool append_command = std::get<bool>(arguments->append_command);
     bool delete_command = std::get<bool>(arguments->delete_command);
+    bool tombstone = std::get<bool>(arguments->tombstone);
+    bool compact_command = std::get<bool>(arguments->compact_command);
     bool concatenate_command = std::get<bool>(arguments->concatenate_command);
-    int word_coding_length = std::get<int>(arguments->word_coding_length);
+    bool transcode_command = std::get<bool>(arguments->transcode_command);
+    bool verify_command = std::get<bool>(arguments->verify_command);
+    bool repair_command = std::get<bool>(arguments->repair_command);
+    std::string word_coding_length = std::get<std::string>(arguments->word_coding_length);
+    BlockLayout layout = std::get<bool>(arguments->interleave) ? BlockLayout::Interleaved : BlockLayout::Packed;
+    bool dedup = std::get<bool>(arguments->dedup);
+    bool compress = std::get<bool>(arguments->compress);
+    std::string error_rate = std::get<std::string>(arguments->error_rate);
+    std::string media = std::get<std::string>(arguments->media);
+    int threads = std::get<int>(arguments->threads);
+    int buffer_size = std::get<int>(arguments->buffer_size);
+    int queue_depth = std::get<int>(arguments->queue_depth);
+    int io_buffers = std::get<int>(arguments->io_buffers);
     std::vector<std::string> free_args;
     for (const auto& arg: arguments->free_args) {
         free_args.push_back(arg);
     }
+    // Data is written to stdout, so messages go to stderr
+    if (to_stdout || ha_file == "/dev/stdout") std::cout.rdbuf(std::cerr.rdbuf());
     std::cout << "-------------\n";
     delete arguments;
+    int result = 0;
     try {
+        SetIoBufferSize((size_t) std::max(buffer_size, 0) << 20);
+        SetIoQueue(std::max(queue_depth, 0), std::max(io_buffers, 0));
+        uint16_t word_ = ParseWord(word_coding_length);
+        std::optional<ErrorTarget> target;
+        if (!error_rate.empty()) target = ErrorTarget{ParseErrorRate(error_rate), MediaErrorRate(media)};
         if (create_command) {
-            CreateHaf(ha_file, free_args, word_coding_length, "");
+            CreateHaf(ha_file, free_args, word_, "", std::max(threads, 1), layout, dedup, compress, target);
             std::cout << "-------------\n";
         }
         if (extract_command) {
-            auto files = ExtractHaf(ha_file, "");
-            std::cout << "Written files (in Haf directory):\n";
+            // Free arguments are names of files to extract if no other command takes them
+            std::vector<std::string> names;
+            if (!create_command && !append_command && !delete_command && !concatenate_command) names = free_args;
+            auto files = ExtractHaf(ha_file, "", std::max(threads, 1), names, to_stdout);
+            std::cout << "Written files:\n";
             for (const std::string& filename: files) {
                 std::cout << '\"' << filename << "\"\n";
             }
@@ -82,13 +165,30 @@ int main(int argc, char** argv) {
             std::cout << "-------------\n";
         }
         if (delete_command) {
-            DeleteFilesFromHaf(ha_file, free_args);
+            DeleteFilesFromHaf(ha_file, free_args, tombstone);
+            std::cout << "-------------\n";
+        }
+        if (compact_command) {
+            CompactHaf(ha_file);
             std::cout << "-------------\n";
         }
         if (concatenate_command) {
             ConcatenateHaf(ha_file, free_args);
             std::cout << "-------------\n";
         }
+        if (transcode_command) {
+            TranscodeHaf(ha_file, word_, layout);
+            std::cout << "-------------\n";
+        }
+        if (verify_command) {
+            // Exit code tells scheduled scrubs that Haf has damaged codewords
+            if (VerifyHaf(ha_file, std::max(threads, 1)).uncorrectable) result = 2;
+            std::cout << "-------------\n";
+        }
+        if (repair_command) {
+            if (VerifyHaf(ha_file, std::max(threads, 1), true).uncorrectable) result = 2;
+            std::cout << "-------------\n";
+        }
         if (list_command) {
             auto files = HafFilesList(ha_file);
             std::cout << "Found files:\n";
@@ -100,5 +200,7 @@ int main(int argc, char** argv) {
     }
     catch (const std::exception& ex) {
         std::cerr << ex.what() << '\n';
+        result = 1;
     }
+    return result;
 }
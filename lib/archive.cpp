@@ -0,0 +1,154 @@
+#include "archive.h"
+#include "directory.h"
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+
+ArchiveWriter::ArchiveWriter(ArchiveSink sink, uint64_t files_number, uint16_t word_, BlockLayout layout)
+    : sink_(std::move(sink)),
+      files_number_(files_number),
+      layout_(layout),
+      encoder_(word_, layout) {
+    // Checks word and layout before anything is written
+    auto header = MakeHeader(0, files_number, word_, HafRevision::Wide, layout);
+    HammingEncoder header_encoder(DEFAULT_LENGTH);
+    std::vector<char> coded;
+    header_encoder.Update(header.data(), header.size(), coded);
+    header_encoder.Finish(coded);
+    Emit(std::as_bytes(std::span(coded)));
+}
+
+IncludedFile& ArchiveWriter::StartFile(const std::string& name) {
+    if (in_file_)
+        throw std::logic_error("Previous file of ArchiveWriter is not ended");
+    if (table_.size() == files_number_)
+        throw std::logic_error("ArchiveWriter got more files than " + std::to_string(files_number_));
+    if (name.empty() || name.size() > MaxFileNameSize(layout_))
+        throw std::runtime_error("Name of included file must be 1 ... " + std::to_string(MaxFileNameSize(layout_)) +
+                                 " bytes, not " + name);
+    IncludedFile file;
+    file.name = name;
+    file.offset = offset_;
+    table_.push_back(std::move(file));
+    return table_.back();
+}
+
+void ArchiveWriter::AddFile(const std::string& name, std::span<const std::byte> data) {
+    IncludedFile& file = StartFile(name);
+    file.size = data.size();
+    auto file_header = MakeFileHeader(name, file.size, HafRevision::Wide);
+    // Header and data are one bitstream as in CreateHaf
+    Code(std::as_bytes(std::span(file_header)));
+    Code(data);
+    FinishBlock();
+    file.coded_size = offset_ - file.offset;
+}
+
+void ArchiveWriter::BeginFile(const std::string& name) {
+    IncludedFile& file = StartFile(name);
+    file.size = 0;
+    file.streamed = true;
+    auto file_header = MakeFileHeader(name, STREAMED_FILE_FLAG, HafRevision::Wide);
+    Code(std::as_bytes(std::span(file_header)));
+    FinishBlock();
+    in_file_ = true;
+}
+
+void ArchiveWriter::Write(std::span<const std::byte> data) {
+    if (!in_file_)
+        throw std::logic_error("ArchiveWriter writes only parts of file started by BeginFile");
+    // Frames are not larger than frames of files read from pipes
+    while (!data.empty()) {
+        uint32_t chunk_size = std::min<uint64_t>(data.size(), IoBufferSize());
+        Code(std::as_bytes(std::span(&chunk_size, 1)));
+        Code(data.first(chunk_size));
+        FinishBlock();
+        table_.back().size += chunk_size;
+        data = data.subspan(chunk_size);
+    }
+}
+
+void ArchiveWriter::EndFile() {
+    if (!in_file_)
+        throw std::logic_error("ArchiveWriter has no file to end");
+    IncludedFile& file = table_.back();
+    uint32_t end_of_frames = 0;
+    Code(std::as_bytes(std::span(&end_of_frames, 1)));
+    Code(std::as_bytes(std::span(&file.size, 1)));
+    FinishBlock();
+    file.coded_size = offset_ - file.offset;
+    in_file_ = false;
+}
+
+void ArchiveWriter::Finish() {
+    if (in_file_)
+        throw std::logic_error("The last file of ArchiveWriter is not ended");
+    if (table_.size() != files_number_)
+        throw std::logic_error("ArchiveWriter got " + std::to_string(table_.size()) + " files instead of " +
+                               std::to_string(files_number_));
+    auto directory = MakeDirectory(table_);
+    Emit(std::as_bytes(std::span(directory)));
+}
+
+void ArchiveWriter::Code(std::span<const std::byte> data) {
+    while (!data.empty()) {
+        auto part = data.first(std::min<size_t>(data.size(), IoBufferSize()));
+        coded_.resize(encoder_.UpdateBound(part.size()));
+        Emit(std::span(coded_).first(encoder_.Update(part, coded_)));
+        data = data.subspan(part.size());
+    }
+}
+
+void ArchiveWriter::FinishBlock() {
+    coded_.resize(encoder_.FinishBound());
+    Emit(std::span(coded_).first(encoder_.Finish(coded_)));
+}
+
+void ArchiveWriter::Emit(std::span<const std::byte> data) {
+    if (data.empty()) return;
+    sink_(data);
+    offset_ += data.size();
+}
+
+ArchiveReader::ArchiveReader(const std::string& filename) : reader_(filename) {
+    if (!reader_.Seekable())
+        throw std::runtime_error(filename + " is a pipe, it can't be read by offsets");
+    ReadTable();
+}
+
+ArchiveReader::ArchiveReader(std::span<const std::byte> haf)
+    : reader_(std::string_view(reinterpret_cast<const char*>(haf.data()), haf.size())) {
+    ReadTable();
+}
+
+void ArchiveReader::ReadTable() {
+    uint64_t haf_size;
+    uint64_t files_number;
+    std::tie(haf_size, files_number, word_, revision_, layout_) = ReadHeader(reader_);
+    std::optional<std::vector<IncludedFile>> files;
+    if (revision_ != HafRevision::Legacy)
+        files = ReadDirectory(reader_, haf_size, files_number, HafHeaderSize(revision_));
+    if (files) ReadLinks(reader_, *files, word_, revision_);
+    files_ = files ? std::move(*files) : ScanFilesTable(reader_, files_number, word_, revision_);
+    std::erase_if(files_, [](const IncludedFile& file) { return file.deleted; });
+}
+
+void ArchiveReader::ReadFile(const IncludedFile& file, const ArchiveSink& sink) const {
+    DecodeFile(reader_, file, word_, revision_, layout_, [&sink](const char* data, size_t size) {
+        sink(std::as_bytes(std::span(data, size)));
+    });
+}
+
+std::vector<std::byte> ArchiveReader::ReadFile(const std::string& name) const {
+    auto file = std::find_if(files_.begin(), files_.end(), [&](const IncludedFile& entry) {
+        return entry.name == name;
+    });
+    if (file == files_.end())
+        throw std::runtime_error("File " + name + " was not found in archive");
+    std::vector<std::byte> data;
+    data.reserve(file->size);
+    ReadFile(*file, [&data](std::span<const std::byte> part) { data.insert(data.end(), part.begin(), part.end()); });
+    return data;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "bitstream.h"
+#include "file_io.h"
+#include "hamming.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+// Gets coded Haf (writer) or decoded data of included file (reader) by parts, part is valid only during the call
+using ArchiveSink = std::function<void(std::span<const std::byte>)>;
+
+/*
+ * Writes Haf of 64-bit revision to sink from memory, nothing is printed. Haf goes only forwards, so its header has
+ * total_size 0 as Haf written to pipe (it ends at the end of output) and number of files is known before them.
+ * Files are added whole by AddFile or by parts as streamed files (BeginFile, Write, EndFile), which are coded
+ * by frames as files read from pipes
+ */
+class ArchiveWriter {
+public:
+    ArchiveWriter(ArchiveSink sink, uint64_t files_number, uint16_t word_ = DEFAULT_LENGTH,
+                  BlockLayout layout = BlockLayout::Packed);
+
+    void AddFile(const std::string& name, std::span<const std::byte> data);
+
+    void BeginFile(const std::string& name);
+
+    // Part of file started by BeginFile, it is coded as frames of at most IoBufferSize() bytes
+    void Write(std::span<const std::byte> data);
+
+    void EndFile();
+
+    // Writes directory, throws if number of added files differs from files_number
+    void Finish();
+
+    // Bytes passed to sink
+    uint64_t Size() const {
+        return offset_;
+    }
+
+    // Entries of added files as in directory of Haf
+    const std::vector<IncludedFile>& Files() const {
+        return table_;
+    }
+
+private:
+    IncludedFile& StartFile(const std::string& name);
+
+    // Codes data by parts of IoBufferSize() bytes
+    void Code(std::span<const std::byte> data);
+
+    void FinishBlock();
+
+    void Emit(std::span<const std::byte> data);
+
+    ArchiveSink sink_;
+    uint64_t files_number_;
+    BlockLayout layout_;
+    HammingEncoder encoder_;
+    std::vector<std::byte> coded_;
+    std::vector<IncludedFile> table_;
+    uint64_t offset_ = 0;
+    bool in_file_ = false;
+};
+
+/*
+ * Reads included files of Haf from file or memory, nothing is printed. Files are found by directory of Haf
+ * (or by their headers if it is damaged), so Haf is not a pipe. Files may be read from many threads
+ */
+class ArchiveReader {
+public:
+    explicit ArchiveReader(const std::string& filename);
+
+    // Memory is not copied and must outlive reader
+    explicit ArchiveReader(std::span<const std::byte> haf);
+
+    // Files without deleted ones
+    const std::vector<IncludedFile>& Files() const {
+        return files_;
+    }
+
+    uint16_t Word() const {
+        return word_;
+    }
+
+    HafRevision Revision() const {
+        return revision_;
+    }
+
+    BlockLayout Layout() const {
+        return layout_;
+    }
+
+    // Decoded data of file is passed to sink by parts
+    void ReadFile(const IncludedFile& file, const ArchiveSink& sink) const;
+
+    // Throws if there is no file with this name
+    std::vector<std::byte> ReadFile(const std::string& name) const;
+
+private:
+    void ReadTable();
+
+    FileReader reader_;
+    uint16_t word_ = DEFAULT_LENGTH;
+    HafRevision revision_ = HafRevision::Wide;
+    BlockLayout layout_ = BlockLayout::Packed;
+    std::vector<IncludedFile> files_;
+};
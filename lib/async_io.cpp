@@ -0,0 +1,173 @@
+#include "async_io.h"
+#include "file_io.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef HAMARC_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+AsyncIo::AsyncIo(unsigned queue_depth) : queue_depth_(queue_depth), slots_(queue_depth) {
+    if (queue_depth == 0)
+        throw std::runtime_error("Queue depth of I/O must be positive");
+    for (uint32_t slot = queue_depth; slot > 0; slot--) {
+        free_slots_.push_back(slot - 1);
+    }
+#ifdef HAMARC_IO_URING
+    // Kernels without io_uring (or with it forbidden) fail the setup, rings are mapped separately for old kernels
+    io_uring_params params{};
+    int fd = (int) syscall(__NR_io_uring_setup, queue_depth, &params);
+    if (fd >= 0) {
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        auto map = [fd](size_t size, off_t offset) {
+            void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+            return ring == MAP_FAILED ? nullptr : ring;
+        };
+        sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+        cq_ring_ = map(cq_ring_size_, IORING_OFF_CQ_RING);
+        sqes_ = map(sqes_size_, IORING_OFF_SQES);
+        if (sq_ring_ && cq_ring_ && sqes_) {
+            auto* sq = static_cast<char*>(sq_ring_);
+            auto* cq = static_cast<char*>(cq_ring_);
+            sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes_ = cq + params.cq_off.cqes;
+            ring_fd_ = fd;
+            return;
+        }
+        if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+        if (cq_ring_) munmap(cq_ring_, cq_ring_size_);
+        if (sqes_) munmap(sqes_, sqes_size_);
+        sq_ring_ = cq_ring_ = sqes_ = nullptr;
+        close(fd);
+    }
+#endif
+    pool_ = std::make_unique<ThreadPool>(queue_depth);
+}
+
+AsyncIo::~AsyncIo() {
+    // Buffers of requests in flight belong to caller, so requests are finished before it frees them
+    while (in_flight_) {
+        size_t in_flight = in_flight_;
+        try {
+            Wait();
+        }
+        catch (const std::exception&) {
+            if (in_flight_ == in_flight) break;
+        }
+    }
+    pool_.reset();
+    if (ring_fd_ < 0) return;
+    munmap(sq_ring_, sq_ring_size_);
+    munmap(cq_ring_, cq_ring_size_);
+    munmap(sqes_, sqes_size_);
+    close(ring_fd_);
+}
+
+void AsyncIo::Read(int fd, char* data, size_t size, uint64_t offset, uint64_t tag) {
+    Submit({false, fd, data, size, offset, tag});
+}
+
+void AsyncIo::Write(int fd, const char* data, size_t size, uint64_t offset, uint64_t tag) {
+    Submit({true, fd, const_cast<char*>(data), size, offset, tag});
+}
+
+void AsyncIo::Submit(const Request& request) {
+    if (in_flight_ >= queue_depth_)
+        throw std::logic_error("Queue of AsyncIo is full");
+    uint32_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    slots_[slot] = request;
+    in_flight_++;
+    if (ring_fd_ < 0) {
+        pending_.emplace_back(slot, pool_->Submit([request]() {
+            if (!request.write) return ReadAt(request.fd, request.data, request.size, request.offset);
+            WriteAt(request.fd, request.data, request.size, request.offset);
+            return request.size;
+        }));
+        return;
+    }
+#ifdef HAMARC_IO_URING
+    // Only this thread writes tail of submission ring, kernel reads it
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & *sq_mask_;
+    auto* entry = static_cast<io_uring_sqe*>(sqes_) + index;
+    std::memset(entry, 0, sizeof(*entry));
+    entry->opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+    entry->fd = request.fd;
+    entry->addr = reinterpret_cast<uint64_t>(request.data);
+    // The rest of larger request is transferred by Complete
+    entry->len = (uint32_t) std::min<size_t>(request.size, INT_MAX);
+    entry->off = request.offset;
+    entry->user_data = slot;
+    sq_array_[index] = index;
+    std::atomic_ref(*sq_tail_).store(tail + 1, std::memory_order_release);
+    while (syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0) < 0) {
+        if (errno != EINTR && errno != EAGAIN)
+            throw std::runtime_error(std::string("Failed to submit I/O: ") + std::strerror(errno));
+    }
+#endif
+}
+
+std::pair<uint64_t, size_t> AsyncIo::Wait() {
+    if (in_flight_ == 0)
+        throw std::logic_error("AsyncIo has no requests in flight");
+    if (ring_fd_ < 0) {
+        auto [slot, result] = std::move(pending_.front());
+        pending_.pop_front();
+        in_flight_--;
+        free_slots_.push_back(slot);
+        // Exception of pread or pwrite is rethrown here
+        size_t done = result.get();
+        return {slots_[slot].tag, done};
+    }
+    uint32_t slot = 0;
+    int64_t result = 0;
+#ifdef HAMARC_IO_URING
+    unsigned head = *cq_head_;
+    while (head == std::atomic_ref(*cq_tail_).load(std::memory_order_acquire)) {
+        if (syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+            throw std::runtime_error(std::string("Failed to wait for I/O: ") + std::strerror(errno));
+    }
+    const auto& completion = static_cast<io_uring_cqe*>(cqes_)[head & *cq_mask_];
+    slot = (uint32_t) completion.user_data;
+    result = completion.res;
+    std::atomic_ref(*cq_head_).store(head + 1, std::memory_order_release);
+#endif
+    in_flight_--;
+    free_slots_.push_back(slot);
+    return {slots_[slot].tag, Complete(slots_[slot], result)};
+}
+
+size_t AsyncIo::Complete(const Request& request, int64_t result) {
+    // Operation unknown to old kernel or interrupted one is done synchronously, it reports real errors itself
+    if (result == -EINVAL || result == -EOPNOTSUPP || result == -EINTR || result == -EAGAIN) result = 0;
+    if (result < 0)
+        throw std::runtime_error(std::string(request.write ? "Failed to write: " : "Failed to read: ") +
+                                 std::strerror((int) -result));
+    auto done = (size_t) result;
+    if (done == request.size) return done;
+    if (request.write) {
+        WriteAt(request.fd, request.data + done, request.size - done, request.offset + done);
+        return request.size;
+    }
+    // Short read is the end of file or a part of large request, ReadAt tells them apart
+    return done + ReadAt(request.fd, request.data + done, request.size - done, request.offset + done);
+}
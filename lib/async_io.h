@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// io_uring is used if headers of kernel have it, HAMARC_NO_IO_URING leaves only the pool of threads
+#if __has_include(<linux/io_uring.h>) && !defined(HAMARC_NO_IO_URING)
+#define HAMARC_IO_URING
+#endif
+
+class ThreadPool;
+
+/*
+ * Positioned reads and writes done in background, at most queue_depth requests are in flight. Requests are
+ * submitted to io_uring if kernel supports it, otherwise they are done by queue_depth threads with pread and pwrite.
+ * Requests are complete: short transfers are finished synchronously, reads are short only at the end of file.
+ * Buffers of requests must live until their completion is returned by Wait (or until destruction, which waits
+ * for requests in flight and drops their errors). Object is used by one thread
+ */
+class AsyncIo {
+public:
+    explicit AsyncIo(unsigned queue_depth);
+
+    AsyncIo(const AsyncIo&) = delete;
+    AsyncIo& operator=(const AsyncIo&) = delete;
+
+    ~AsyncIo();
+
+    // Submits are allowed only while InFlight() < QueueDepth(), tag is returned by Wait with the completion
+    void Read(int fd, char* data, size_t size, uint64_t offset, uint64_t tag);
+
+    void Write(int fd, const char* data, size_t size, uint64_t offset, uint64_t tag);
+
+    // Waits for any request in flight, returns its tag and number of transferred bytes. Throws if request failed
+    std::pair<uint64_t, size_t> Wait();
+
+    size_t InFlight() const {
+        return in_flight_;
+    }
+
+    unsigned QueueDepth() const {
+        return queue_depth_;
+    }
+
+    bool UsesIoUring() const {
+        return ring_fd_ >= 0;
+    }
+
+private:
+    struct Request {
+        bool write;
+        int fd;
+        char* data;
+        size_t size;
+        uint64_t offset;
+        uint64_t tag;
+    };
+
+    void Submit(const Request& request);
+
+    // Finishes short or unsupported transfer of request with pread or pwrite
+    size_t Complete(const Request& request, int64_t result);
+
+    unsigned queue_depth_;
+    size_t in_flight_ = 0;
+    // Requests by index of slot, index is user_data of io_uring request
+    std::vector<Request> slots_;
+    std::vector<uint32_t> free_slots_;
+
+    int ring_fd_ = -1;
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    void* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+    // Fields of rings (offsets are given by kernel)
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    void* cqes_ = nullptr;
+
+    // Fallback: results of requests in order of submission
+    std::unique_ptr<ThreadPool> pool_;
+    std::deque<std::pair<uint32_t, std::future<size_t>>> pending_;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+// Bit-level cursors over memory shared by scalar and vector Hamming kernels (not a public interface)
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+inline uint64_t LoadBigEndian(const uint8_t* ptr) {
+    uint64_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return __builtin_bswap64(value);
+}
+
+inline void StoreBigEndian(uint8_t* ptr, uint64_t value) {
+    value = __builtin_bswap64(value);
+    std::memcpy(ptr, &value, sizeof(value));
+}
+
+// Bit of the limb holding stream position pos (0-indexed) of the limb
+inline uint64_t LimbBit(uint32_t pos) {
+    return 1ull << (63 - pos % 64);
+}
+
+// Reads bits of the stream as left-aligned 64-bit values, bits after the end are zeros
+class BitCursor {
+public:
+    BitCursor(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    uint64_t Get(unsigned count) {
+        uint64_t value = Peek();
+        pos_ += count;
+        return count == 64 ? value : value & ~(~0ull >> count);
+    }
+
+    // Faster version for count <= 56: bits are in 8 bytes from the current byte
+    uint64_t GetShort(unsigned count) {
+        size_t byte = pos_ / CHAR_BIT;
+        uint64_t value = byte + sizeof(uint64_t) <= size_ ? LoadBigEndian(data_ + byte) << (pos_ % CHAR_BIT) : Peek();
+        pos_ += count;
+        return value & ~(~0ull >> count);
+    }
+
+private:
+    uint64_t Peek() const {
+        size_t byte = pos_ / CHAR_BIT;
+        unsigned shift = pos_ % CHAR_BIT;
+        if (byte + sizeof(uint64_t) < size_) {
+            uint64_t value = LoadBigEndian(data_ + byte);
+            return shift ? (value << shift) | (data_[byte + sizeof(uint64_t)] >> (CHAR_BIT - shift)) : value;
+        }
+        // Near the end of data - byte by byte
+        uint64_t value = 0;
+        for (size_t i = 0; i < sizeof(uint64_t) + 1; i++) {
+            uint8_t next = byte + i < size_ ? data_[byte + i] : 0;
+            if (i < sizeof(uint64_t)) value |= (uint64_t) next << (56 - CHAR_BIT * i);
+            else if (shift) return (value << shift) | (next >> (CHAR_BIT - shift));
+        }
+        return value;
+    }
+
+    const uint8_t* data_;
+    size_t size_;
+    uint64_t pos_ = 0;
+};
+
+// Bit accumulator: collects left-aligned values in 64-bit word and stores it when it is full
+class BitPacker {
+public:
+    explicit BitPacker(uint8_t* out) : out_(out) {}
+
+    void Put(uint64_t bits, unsigned count) {
+        acc_ |= bits >> fill_;
+        fill_ += count;
+        if (fill_ >= 64) {
+            StoreBigEndian(out_, acc_);
+            out_ += sizeof(uint64_t);
+            fill_ -= 64;
+            acc_ = fill_ ? bits << (count - fill_) : 0;
+        }
+    }
+
+    // Writes remaining bits padded with zeros to the whole byte
+    void Flush() {
+        for (unsigned i = 0; i * CHAR_BIT < fill_; i++) {
+            *out_++ = (uint8_t) (acc_ >> (56 - CHAR_BIT * i));
+        }
+        acc_ = 0;
+        fill_ = 0;
+    }
+
+private:
+    uint8_t* out_;
+    uint64_t acc_ = 0;
+    unsigned fill_ = 0;
+};
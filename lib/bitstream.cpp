@@ -1,699 +1,1945 @@
 #include "bitstream.h"
+#include "checksum.h"
+#include "directory.h"
+#include "file_io.h"
+#include "lz.h"
+#include "thread_pool.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <iostream>
-#include <fstream>
 #include <filesystem>
 #include <cmath>
+#include <climits>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 // !!! Haf structure described in function CreateHaf !!!
 
-uint8_t CountAddedBits(uint8_t word) {
-    // Control bits depends on word length
-    // Calculated with formula 2^added_bits_per_word >= added_bits_per_word + word_length + 1
-    switch (word) {
-        case 0:
-            throw std::logic_error("Word length must be in range 1 ... 255");
-        case 1:
-            return 2;
-        case 2 ... 4:
-            return 3;
-        case 5 ... 11:
-            return 4;
-        case 12 ... 26:
-            return 5;
-        case 27 ... 57:
-            return 6;
-        case 58 ... 120:
-            return 7;
-        case 121 ... 247:
-            return 8;
-        default:
-            return 9;
+uint64_t HafHeaderSize(HafRevision revision) {
+    return revision == HafRevision::Wide ? WIDE_HEADER_SIZE : HEADER_SIZE;
+}
+
+uint64_t IncludedFileHeaderSize(const std::string& filename, HafRevision revision) {
+    return INCLUDED_FILE_NAME_SIZE + (filename.size() > UINT8_MAX ? LONG_FILE_NAME_SIZE : 0) + filename.size() +
+           (revision == HafRevision::Wide ? WIDE_INCLUDED_FILE_SIZE : INCLUDED_FILE_SIZE);
+}
+
+uint64_t MaxFileNameSize(BlockLayout layout) {
+    return layout == BlockLayout::Interleaved ? UINT8_MAX : MAX_FILE_NAME_SIZE;
+}
+
+void AppendFileName(std::vector<char>& data, const std::string& filename) {
+    if (filename.size() > MAX_FILE_NAME_SIZE)
+        throw std::runtime_error("Name " + filename + " is longer than " + std::to_string(MAX_FILE_NAME_SIZE) + "B");
+    // Names are not empty, so size 0 marks long name
+    uint8_t filename_size = filename.size() > UINT8_MAX ? 0 : filename.size();
+    data.push_back((char) filename_size);
+    if (filename_size == 0) {
+        uint16_t long_filename_size = filename.size();
+        data.insert(data.end(), (char*) &long_filename_size, (char*) &long_filename_size + LONG_FILE_NAME_SIZE);
     }
+    data.insert(data.end(), filename.begin(), filename.end());
+}
+
+std::pair<uint64_t, uint64_t> FileNameSize(const char* data) {
+    auto filename_size = (uint8_t) data[0];
+    if (filename_size != 0) return {INCLUDED_FILE_NAME_SIZE + filename_size, filename_size};
+    uint16_t long_filename_size;
+    std::memcpy(&long_filename_size, data + INCLUDED_FILE_NAME_SIZE, LONG_FILE_NAME_SIZE);
+    return {INCLUDED_FILE_NAME_SIZE + LONG_FILE_NAME_SIZE + long_filename_size, long_filename_size};
+}
+
+uint64_t FileBlockBytes(const IncludedFile& file, HafRevision revision) {
+    uint64_t header_size = IncludedFileHeaderSize(file.name, revision);
+    if (file.word) return header_size + FILE_WORD_SIZE;
+    if (file.streamed || file.compressed) return header_size;
+    return header_size + (file.linked ? LINK_OFFSET_SIZE : file.size);
+}
+
+uint64_t FileCodedSize(const IncludedFile& file, uint16_t word_, HafRevision revision) {
+    uint64_t coded_size = EncodedSize(word_, FileBlockBytes(file, revision));
+    if (file.word && !file.streamed && !file.compressed) coded_size += EncodedSize(file.word, file.size);
+    return coded_size;
+}
+
+uint64_t FlaggedFileSize(const IncludedFile& file) {
+    return (file.streamed ? STREAMED_FILE_FLAG : file.size) | (file.deleted ? DELETED_FILE_FLAG : 0) |
+           (file.linked ? LINKED_FILE_FLAG : 0) | (file.compressed ? COMPRESSED_FILE_FLAG : 0) |
+           (file.word ? OWN_WORD_FILE_FLAG : 0);
 }
 
 // Currently used for only header, maybe useful in future for not only it
-void WriteHeader(const std::vector<char>& data, std::ofstream& stream) {
-    const auto extra_bits = CountAddedBits(DEFAULT_LENGTH);
-    std::vector<bool> bits;
-    uint8_t byte = 0;
-    uint16_t start_pos = 0;
-    while (byte < data.size()) {
-
-        // Adding data for coding
-        // need_bytes counted with formula: (bits.size() - start_pos) + need_bytes * CHAR_BIT >= WORD_LENGTH,
-        // where (bits.size() - start_pos) is remaining uncoded bits count
-        auto need_bytes = std::ceil((double) (DEFAULT_LENGTH - (bits.size() - start_pos)) / CHAR_BIT);
-        for (auto i = 0; (i < need_bytes) && (byte < data.size()); i++, byte++) {
-            char word = data[byte];
-            for (auto j = 0; j < CHAR_BIT; j++) {
-                bits.emplace_back(word & 0b10000000);
-                word <<= 1;
-            }
+void WriteHeader(const std::vector<char>& data, BufferedWriter& writer) {
+    // Header is always coded with 11-bit words, both header sizes are whole groups of 8 codewords,
+    // so there are no padding bits
+    HammingEncoder encoder(DEFAULT_LENGTH);
+    std::vector<char> coded;
+    encoder.Update(data.data(), data.size(), coded);
+    encoder.Finish(coded);
+    writer.Write(coded.data(), coded.size());
+}
+
+// Header of Haf of given revision, 32-bit revisions are written only for appending to old Haf
+std::vector<char> MakeHeader(uint64_t haf_size, uint64_t files_number, uint16_t word_, HafRevision revision,
+                             BlockLayout layout) {
+    std::vector<char> header;
+    auto append = [&header](const auto& value) {
+        header.insert(header.end(), (char*) &value, (char*) &value + sizeof(value));
+    };
+    if (revision == HafRevision::Wide) {
+        header = {'H', 'C'};
+        append(haf_size);
+        append(files_number);
+        if ((word_ & ALIGNED_PROFILE_FLAG) && layout != BlockLayout::Packed)
+            throw std::logic_error("Codewords of aligned profiles can't be interleaved");
+        append((uint8_t) word_);
+        append((uint8_t) (layout == BlockLayout::Interleaved));
+        append((uint8_t) (word_ >> 8));
+        // Reserved byte
+        header.resize(WIDE_HEADER_SIZE_WITHOUT_CODING, '\0');
+        return header;
+    }
+
+    if (haf_size > UINT32_MAX || files_number > UINT32_MAX)
+        throw std::runtime_error("Haf is too large for its 32-bit revision, create new Haf instead");
+    if (layout != BlockLayout::Packed)
+        throw std::logic_error("Codewords of 32-bit revision of Haf can't be interleaved");
+    if (word_ & ALIGNED_PROFILE_FLAG)
+        throw std::logic_error("32-bit revision of Haf can't be coded with aligned profile");
+    header = {'H', revision == HafRevision::Legacy ? 'A' : 'B'};
+    append((uint32_t) haf_size);
+    append((uint32_t) files_number);
+    append((uint8_t) word_);
+    return header;
+}
+
+// Files are included without directories
+std::string IncludedFileName(const std::string& filename_with_path) {
+    if (filename_with_path.find_last_of("/\\") == std::string::npos) return filename_with_path;
+    return filename_with_path.substr(filename_with_path.find_last_of("/\\") + 1);
+}
+
+std::vector<InputFile> ListInputFiles(const std::vector<std::string>& args, const std::string& filename_end) {
+    std::vector<InputFile> files;
+    for (const auto& arg: args) {
+        const std::string path = arg + filename_end;
+        std::error_code error;
+        if (!std::filesystem::is_directory(path, error)) {
+            // Missing files are reported by MakeFilesTable
+            files.push_back({path, IncludedFileName(arg)});
+            continue;
         }
+        // Names start with name of directory itself, "." and "/" give names relative to them
+        std::filesystem::path root = std::filesystem::path(path).lexically_normal();
+        if (!root.has_filename()) root = root.parent_path();
+        std::string prefix = root.filename().string();
+        if (prefix == "." || prefix == "..") prefix.clear();
 
-        // Adding extra bits
-        for (uint8_t bit = 0; bit < extra_bits; bit++) {
-            auto shift = (uint16_t) pow(2, bit);
-            bits.emplace(bits.begin() + start_pos + shift - 1, false);
+        std::vector<InputFile> found;
+        for (const auto& entry: std::filesystem::recursive_directory_iterator(root)) {
+            // Links to directories are not followed, pipes and devices are included only by their own names
+            if (!entry.is_regular_file()) continue;
+            std::string name = entry.path().lexically_relative(root).generic_string();
+            if (!prefix.empty()) name = prefix + "/" + name;
+            found.push_back({entry.path().string(), std::move(name)});
         }
+        // Order of directory entries is arbitrary, so Haf of the same tree is the same
+        std::sort(found.begin(), found.end(), [](const InputFile& a, const InputFile& b) { return a.name < b.name; });
+        files.insert(files.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+    }
+    return files;
+}
 
-        // Writing extra bits
-        uint16_t end_pos = start_pos + DEFAULT_LENGTH + extra_bits;
-        for (uint8_t bit = 0; bit < extra_bits; bit++) {
-            auto shift = (uint16_t) pow(2, bit);
-            uint8_t extra_bit = '\0';
-            for (uint16_t pos = start_pos + shift - 1; pos < end_pos; pos += 2 * shift) {
-                for (auto i = 0; (pos + i < end_pos) && (i < shift); i++) {
-                    extra_bit ^= bits[pos + i];
-                }
-            }
-            bits[start_pos + shift - 1] = extra_bit;
+// Entries of files which will be written one after another from offset
+std::vector<IncludedFile> MakeFilesTable(const std::vector<InputFile>& files, uint16_t word_, uint64_t offset,
+                                         HafRevision revision, BlockLayout layout, unsigned threads) {
+    // Each file is checked by one stat, stats of many small files wait for disk in parallel
+    std::vector<struct stat> stats(files.size());
+    auto stat_files = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (stat(files[i].path.c_str(), &stats[i]) != 0 || S_ISDIR(stats[i].st_mode))
+                throw std::runtime_error("File [" + files[i].path + "] does not exist");
+        }
+    };
+    if (threads <= 1 || files.size() < 2 * threads) {
+        stat_files(0, files.size());
+    } else {
+        ThreadPool pool(threads);
+        std::vector<std::future<void>> parts;
+        for (unsigned part = 0; part < threads; part++) {
+            parts.push_back(pool.Submit([&, part]() {
+                stat_files(files.size() * part / threads, files.size() * (part + 1) / threads);
+            }));
+        }
+        for (auto& part: parts) {
+            part.get();
         }
+    }
 
-        // Writing data to stream
-        while (end_pos >= CHAR_BIT) {
-            end_pos -= CHAR_BIT;
-            char word = '\0';
-            for (auto i = 0; i < CHAR_BIT; i++) {
-                if (bits[0]) word++;
-                bits.erase(bits.begin());
-                if (i != CHAR_BIT - 1) word <<= 1;
-            }
-            stream << word;
-        }
-        start_pos = end_pos;
-    }
-    // No remaining bits for this data size because of
-    // (HEADER_SIZE_WITHOUT_CODING * (DEFAULT_LENGTH + extra_bits)) is divisible by DEFAULT_LENGTH
-    // where HEADER_SIZE_WITHOUT_CODING is 11 (described in CreateHaf)
-}
-
-// By analogy of writing data in 11-bit (previous function), but with files and TODO: with arbitrary word length
-void WriteFiles(const std::vector<std::string>& files, std::ofstream& stream, const uint8_t word_,
-                const std::string& filename_end) {
-    const auto extra_bits = CountAddedBits(word_);
-    char byte;
-    for (const std::string& filename_with_path: files) {
-        std::vector<bool> bits;
-        uint16_t start_pos = 0;
-        auto input = std::ifstream(filename_with_path + filename_end, std::ios::binary);
-        if (!input.is_open()) {
-            throw std::runtime_error("Failed to open " + filename_with_path += filename_end);
-        }
-
-        std::string filename = filename_with_path;
-        if (filename_with_path.find_last_of("/\\") != std::string::npos)
-            filename = filename_with_path.substr(filename_with_path.find_last_of("/\\") + 1);
-
-        // Creating file header
-        std::vector<char> file_header;
-        uint8_t filename_size = filename.size();
-        uint32_t file_size = std::filesystem::file_size(filename_with_path + filename_end);
-        file_header.insert(file_header.end(),
-                           (char*) &filename_size,
-                           (char*) (&filename_size + sizeof(filename_size)));
-        file_header.insert(file_header.end(),
-                           (char*) filename.c_str(),
-                           (char*) filename.c_str() + filename.size());
-        file_header.insert(file_header.end(),
-                           (char*) &file_size,
-                           (char*) &file_size + sizeof(file_size));
-
-        // Writing data, as Haf-header in 11-bit coding, adding header before each file
-        while (!file_header.empty() || input.get(byte)) {
-            if (!file_header.empty()) {
-                byte = file_header[0];
-                file_header.erase(file_header.begin());
-            }
-            for (auto j = 0; j < CHAR_BIT; j++) {
-                bits.emplace_back(byte & 0b10000000);
-                byte <<= 1;
+    std::vector<IncludedFile> table;
+    for (size_t i = 0; i < files.size(); i++) {
+        const std::string& path = files[i].path;
+        IncludedFile file;
+        file.name = files[i].name;
+        if (file.name.size() > MaxFileNameSize(layout))
+            throw std::runtime_error("Name of file [" + path + "] is longer than " +
+                                     std::to_string(MaxFileNameSize(layout)) + "B" +
+                                     (layout == BlockLayout::Interleaved ? " of Haf with interleaved codewords" : ""));
+        if (revision != HafRevision::Wide && file.name.size() > UINT8_MAX)
+            throw std::runtime_error("Name of file [" + path + "] is too long for 32-bit revision of Haf, "
+                                     "create new Haf instead");
+        if (!S_ISREG(stats[i].st_mode)) {
+            // Pipes and devices are read to their end, sizes and offsets are set by WriteFiles
+            if (revision != HafRevision::Wide)
+                throw std::runtime_error("File [" + path + "] is not a regular file, it can't be included into "
+                                         "32-bit revision of Haf");
+            file.size = 0;
+            file.offset = offset;
+            file.coded_size = 0;
+            file.streamed = true;
+            table.push_back(std::move(file));
+            continue;
+        }
+        file.size = stats[i].st_size;
+        if (revision != HafRevision::Wide && file.size > UINT32_MAX)
+            throw std::runtime_error("File [" + path + "] is too large for 32-bit revision of Haf, "
+                                     "create new Haf instead");
+        file.offset = offset;
+        file.coded_size = EncodedSize(word_, IncludedFileHeaderSize(file.name, revision) + file.size);
+        offset += file.coded_size;
+        table.push_back(std::move(file));
+    }
+    return table;
+}
+
+// Header of included file: [file_name_size][file_name][file_size]
+std::vector<char> MakeFileHeader(const std::string& filename, uint64_t file_size, HafRevision revision) {
+    std::vector<char> file_header;
+    AppendFileName(file_header, filename);
+    // Sizes are little-endian, the lower 4 bytes are the 32-bit size of old revisions
+    file_header.insert(file_header.end(),
+                       (char*) &file_size,
+                       (char*) &file_size + (revision == HafRevision::Wide ? WIDE_INCLUDED_FILE_SIZE
+                                                                           : INCLUDED_FILE_SIZE));
+    return file_header;
+}
+
+std::vector<char> MakeFileHeader(const IncludedFile& file, HafRevision revision) {
+    auto file_header = MakeFileHeader(file.name, FlaggedFileSize(file), revision);
+    if (file.word) file_header.insert(file_header.end(), (char*) &file.word, (char*) &file.word + FILE_WORD_SIZE);
+    return file_header;
+}
+
+/*
+ * Target is shared by data and headers. Wrong bit of data damages only codeword with it, but wrong bit of header
+ * damages the whole file, so headers are checked for target of all data as wrong bits of their files. Sizes of
+ * streamed files are not known, their frames are taken as their data
+ */
+uint16_t ChooseFileWords(std::vector<IncludedFile>& table, const ErrorTarget& target, BlockLayout layout,
+                         bool compress) {
+    const ErrorTarget half_target{target.residual_rate / 2, target.bit_error_rate};
+    auto check_word = [&](uint16_t word) {
+        if (word == 0)
+            throw std::runtime_error("No word gives residual error rate " + ErrorTargetName(target));
+        return word;
+    };
+    const uint64_t chunk_bytes = IoBufferSize();
+    auto data_size = [&](const IncludedFile& file) { return file.streamed ? chunk_bytes : file.size; };
+
+    // Words of data depend only on size of file
+    std::map<uint64_t, uint16_t> words_by_size;
+    std::vector<uint16_t> data_words;
+    uint64_t headers_size = 0;
+    double data_bits = 0;
+    double damaged_bits = 0;
+    for (const auto& file: table) {
+        uint64_t size = data_size(file);
+        auto word = words_by_size.find(size);
+        if (word == words_by_size.end()) {
+            // Frame which can't be decompressed loses its whole chunk
+            double frame_bits = compress && !file.streamed ? 8.0 * std::min(size, chunk_bytes) : 0;
+            word = words_by_size.emplace(size, check_word(ChooseWord(half_target, frame_bits, layout,
+                                                                     [size](uint16_t word) {
+                return EncodedSize(word, size);
+            }))).first;
+        }
+        data_words.push_back(word->second);
+        uint64_t header_size = IncludedFileHeaderSize(file.name, HafRevision::Wide) + FILE_WORD_SIZE;
+        headers_size += header_size;
+        data_bits += 8.0 * (header_size + size);
+        damaged_bits += 8.0 * header_size * 8.0 * (header_size + size);
+    }
+    uint16_t headers_word = DEFAULT_LENGTH;
+    if (!table.empty()) {
+        // Rate of wrong bits of headers is rate of wrong bits of their files, it is shared by data of all files
+        const ErrorTarget headers_target{half_target.residual_rate * data_bits / (8.0 * headers_size),
+                                         target.bit_error_rate};
+        headers_word = check_word(ChooseWord(headers_target, damaged_bits / (8.0 * headers_size), layout,
+                                             [&](uint16_t word) {
+            uint64_t coded_size = 0;
+            for (const auto& file: table) {
+                coded_size += EncodedSize(word, IncludedFileHeaderSize(file.name, HafRevision::Wide) + FILE_WORD_SIZE);
             }
-            if (bits.size() - start_pos < word_) continue;
+            return coded_size;
+        }));
+    }
+
+    uint64_t offset = table.empty() ? 0 : table.front().offset;
+    for (size_t i = 0; i < table.size(); i++) {
+        IncludedFile& file = table[i];
+        // Empty file has no data to code
+        file.word = data_words[i] == headers_word || data_size(file) == 0 ? 0 : data_words[i];
+        file.offset = offset;
+        if (!file.streamed) file.coded_size = FileCodedSize(file, headers_word, HafRevision::Wide);
+        offset += file.coded_size;
+    }
+    return headers_word;
+}
+
+/*
+ * Only files of the same size may have the same data, so only they are hashed. Files with equal sizes and hashes
+ * are compared byte by byte, so files whose hashes collide are not linked. File is linked to the first file with
+ * its data, files not larger than link are stored as they are. Links are offsets for 64-bit revision of Haf
+ */
+uint64_t LinkDuplicateFiles(const std::vector<InputFile>& files, std::vector<IncludedFile>& table,
+                            const uint16_t word_, unsigned threads) {
+    std::unordered_map<uint64_t, std::vector<size_t>> files_by_size;
+    for (size_t i = 0; i < table.size(); i++) {
+        if (!table[i].streamed && table[i].size > LINK_OFFSET_SIZE) files_by_size[table[i].size].push_back(i);
+    }
+    std::vector<size_t> hashed;
+    for (const auto& [size, same_size]: files_by_size) {
+        if (same_size.size() > 1) hashed.insert(hashed.end(), same_size.begin(), same_size.end());
+    }
+    std::sort(hashed.begin(), hashed.end());
 
-            for (uint8_t bit = 0; bit < extra_bits; bit++) {
-                auto shift = (uint16_t) pow(2, bit);
-                bits.emplace(bits.begin() + start_pos + shift - 1, false);
+    std::vector<uint64_t> hashes(table.size());
+    auto hash_file = [&](size_t i) {
+        FileReader input(files[i].path);
+        SequentialReader file_input(input, 0, table[i].size);
+        Hash64 hash;
+        for (uint64_t position = 0; position < table[i].size;) {
+            auto data = file_input.Next();
+            if (data.empty())
+                throw std::runtime_error("Unexpected end of " + files[i].path);
+            hash.Update(data.data(), data.size());
+            position += data.size();
+        }
+        hashes[i] = hash.Digest();
+    };
+    if (threads > 1) {
+        ThreadPool pool(threads);
+        std::deque<std::future<void>> pending;
+        for (size_t i: hashed) {
+            pending.push_back(pool.Submit([&hash_file, i]() { hash_file(i); }));
+            if (pending.size() >= 2 * threads) {
+                pending.front().get();
+                pending.pop_front();
             }
+        }
+        for (auto& file: pending) {
+            file.get();
+        }
+    } else {
+        for (size_t i: hashed) {
+            hash_file(i);
+        }
+    }
 
-            uint16_t end_pos = start_pos + word_ + extra_bits;
-            for (uint8_t bit = 0; bit < extra_bits; bit++) {
-                auto shift = (uint16_t) pow(2, bit);
-                uint8_t extra_bit = '\0';
-                for (uint16_t pos = start_pos + shift - 1; pos < end_pos; pos += 2 * shift) {
-                    for (auto i = 0; (pos + i < end_pos) && (i < shift); i++) {
-                        extra_bit ^= bits[pos + i];
-                    }
-                }
-                bits[start_pos + shift - 1] = extra_bit;
+    auto same_data = [&](size_t first, size_t second) {
+        FileReader first_input(files[first].path);
+        FileReader second_input(files[second].path);
+        std::vector<char> first_buffer;
+        std::vector<char> second_buffer;
+        for (uint64_t position = 0; position < table[first].size;) {
+            uint64_t part = std::min<uint64_t>(IoBufferSize(), table[first].size - position);
+            auto first_data = first_input.Read(position, part, first_buffer);
+            auto second_data = second_input.Read(position, part, second_buffer);
+            if (first_data.size() != part || second_data.size() != part)
+                throw std::runtime_error("Unexpected end of " + files[first_data.size() != part ? first : second].path);
+            if (std::memcmp(first_data.data(), second_data.data(), part) != 0) return false;
+            position += part;
+        }
+        return true;
+    };
+    // Files of one size and hash whose data differs, in order of table
+    std::map<std::pair<uint64_t, uint64_t>, std::vector<size_t>> originals;
+    uint64_t linked_files = 0;
+    for (size_t i: hashed) {
+        auto& same_hash = originals[{table[i].size, hashes[i]}];
+        auto original = std::find_if(same_hash.begin(), same_hash.end(), [&](size_t j) { return same_data(j, i); });
+        if (original == same_hash.end()) {
+            same_hash.push_back(i);
+            continue;
+        }
+        table[i].linked = true;
+        table[i].link = *original;
+        // Block of linked file is coded as header
+        table[i].word = 0;
+        linked_files++;
+    }
+
+    // Links are indices of files until files get their offsets
+    uint64_t offset = table.empty() ? 0 : table.front().offset;
+    for (auto& file: table) {
+        file.offset = offset;
+        if (!file.streamed) file.coded_size = FileCodedSize(file, word_, HafRevision::Wide);
+        offset += file.coded_size;
+    }
+    for (auto& file: table) {
+        if (file.linked) file.link = table[file.link].offset;
+    }
+    return linked_files;
+}
+
+// Block of linked file: [file header][link], file_size of header has LINKED_FILE_FLAG. Block is decoded by its
+// prefix, but link after the longest header goes beyond INTERLEAVED_PREFIX_SIZE, so block is packed (it differs
+// from interleaved one only for 1-bit words, others have no whole slice in it)
+std::vector<char> MakeLinkBlock(const IncludedFile& file, const uint16_t word_) {
+    auto block = MakeFileHeader(file.name, file.size | LINKED_FILE_FLAG, HafRevision::Wide);
+    block.insert(block.end(), (char*) &file.link, (char*) &file.link + LINK_OFFSET_SIZE);
+    std::vector<char> coded;
+    HammingEncoder encoder(word_);
+    encoder.Update(block.data(), block.size(), coded);
+    encoder.Finish(coded);
+    return coded;
+}
+
+std::vector<char> MakeCompressedFrame(const char* chunk, size_t size) {
+    // Compressed frame is used only if it is smaller than chunk with its size
+    std::vector<char> frame(2 * FRAME_SIZE_SIZE + size);
+    uint32_t compressed_size = 0;
+    if (size > 2 * FRAME_SIZE_SIZE)
+        compressed_size = LzCompress(chunk, size, frame.data() + 2 * FRAME_SIZE_SIZE, size - FRAME_SIZE_SIZE - 1);
+    uint32_t frame_size = compressed_size ? FRAME_SIZE_SIZE + compressed_size : size;
+    if (compressed_size) {
+        uint32_t chunk_size = size;
+        std::memcpy(&frame[FRAME_SIZE_SIZE], &chunk_size, FRAME_SIZE_SIZE);
+        frame_size |= COMPRESSED_FRAME_FLAG;
+    } else {
+        std::memcpy(&frame[FRAME_SIZE_SIZE], chunk, size);
+    }
+    std::memcpy(&frame[0], &frame_size, FRAME_SIZE_SIZE);
+    frame.resize(FRAME_SIZE_SIZE + (frame_size & ~COMPRESSED_FRAME_FLAG));
+    return frame;
+}
+
+std::vector<char> MakeEndFrame(uint64_t file_size) {
+    std::vector<char> frame(FRAME_SIZE_SIZE + WIDE_INCLUDED_FILE_SIZE);
+    std::memcpy(&frame[FRAME_SIZE_SIZE], &file_size, WIDE_INCLUDED_FILE_SIZE);
+    return frame;
+}
+
+bool FramesAreSmaller(const IncludedFile& file, uint64_t first_frame_bytes, const uint16_t word_) {
+    const uint64_t chunk_bytes = IoBufferSize();
+    // Data of file with its own word is coded after block of header in both cases
+    const uint16_t data_word = file.word ? file.word : word_;
+    uint64_t header_size = IncludedFileHeaderSize(file.name, HafRevision::Wide);
+    uint64_t header_coded_size = EncodedSize(word_, header_size + (file.word ? FILE_WORD_SIZE : 0));
+    uint64_t rest = file.size - std::min(file.size, chunk_bytes);
+    // Frame of chunk is not larger than the chunk with its size
+    uint64_t frames_size = header_coded_size + EncodedSize(data_word, first_frame_bytes) +
+                           rest / chunk_bytes * EncodedSize(data_word, FRAME_SIZE_SIZE + chunk_bytes) +
+                           (rest % chunk_bytes ? EncodedSize(data_word, FRAME_SIZE_SIZE + rest % chunk_bytes) : 0) +
+                           EncodedSize(data_word, FRAME_SIZE_SIZE + WIDE_INCLUDED_FILE_SIZE);
+    if (file.word) return frames_size < header_coded_size + EncodedSize(data_word, file.size);
+    return frames_size < EncodedSize(word_, header_size + file.size);
+}
+
+/*
+ * Each file is coded as one block: [file header][file data], padded to the whole codeword and byte.
+ * Streamed file is coded as block of its header and frames, its entry of table gets size after writing.
+ * If compress is set, file whose frames of compressed chunks are smaller than its block is coded by them.
+ * Data of file with its own word is coded with it after block of header. Offsets of all entries are set as files
+ * are written
+ */
+void WriteFiles(const std::vector<InputFile>& files, std::vector<IncludedFile>& table, BufferedWriter& writer,
+                const uint16_t word_, HafRevision revision, BlockLayout layout, bool compress) {
+    HammingEncoder encoder(word_, layout);
+    std::vector<char> coded;
+    coded.reserve(EncodedSize(word_, IoBufferSize()) + IoBufferSize() / 8);
+    auto write_coded = [&]() {
+        writer.Write(coded.data(), coded.size());
+        coded.clear();
+    };
+    auto write_block = [&](HammingEncoder& block_encoder, const std::vector<char>& data) {
+        block_encoder.Update(data.data(), data.size(), coded);
+        block_encoder.Finish(coded);
+        write_coded();
+    };
+    // Offsets of files after streamed or compressed ones are known only when they are written, links are moved
+    // with them
+    std::unordered_map<uint64_t, uint64_t> written_offsets;
+    for (size_t i = 0; i < files.size(); i++) {
+        const std::string& path = files[i].path;
+        IncludedFile& file = table[i];
+        if (!file.streamed) written_offsets[file.offset] = writer.Offset();
+        file.offset = writer.Offset();
+        if (file.linked) {
+            file.link = written_offsets.at(file.link);
+            auto block = MakeLinkBlock(file, word_);
+            writer.Write(block.data(), block.size());
+            continue;
+        }
+        FileReader input(path);
+        HammingEncoder data_encoder(file.word ? file.word : word_, layout);
+        if (file.streamed) {
+            write_block(encoder, MakeFileHeader(file, revision));
+            SequentialReader frames_input(input, 0, UINT64_MAX);
+            for (file.size = 0;;) {
+                auto data = frames_input.Next();
+                if (data.empty()) break;
+                uint32_t chunk_size = data.size();
+                data_encoder.Update((char*) &chunk_size, sizeof(chunk_size), coded);
+                data_encoder.Update(data.data(), data.size(), coded);
+                data_encoder.Finish(coded);
+                write_coded();
+                file.size += data.size();
             }
+            write_block(data_encoder, MakeEndFrame(file.size));
+            file.coded_size = writer.Offset() - file.offset;
+            continue;
+        }
 
-            while (end_pos >= CHAR_BIT) {
-                end_pos -= CHAR_BIT;
-                char word = '\0';
-                for (auto i = 0; i < CHAR_BIT; i++) {
-                    if (bits[0]) word++;
-                    bits.erase(bits.begin());
-                    if (i != CHAR_BIT - 1) word <<= 1;
+        uint64_t file_size = file.size;
+        input.AdviseSequential(0, file_size);
+        SequentialReader file_input(input, 0, file_size);
+        auto next_part = [&]() {
+            auto data = file_input.Next();
+            if (data.empty())
+                throw std::runtime_error("Unexpected end of " + path);
+            return data;
+        };
+        // Frames or block are chosen by the first part
+        std::string_view first_part;
+        if (compress && file_size > 0) {
+            first_part = next_part();
+            auto frame = MakeCompressedFrame(first_part.data(), first_part.size());
+            if (FramesAreSmaller(file, frame.size(), word_)) {
+                file.compressed = true;
+                write_block(encoder, MakeFileHeader(file, revision));
+                write_block(data_encoder, frame);
+                for (uint64_t position = first_part.size(); position < file_size;) {
+                    auto data = next_part();
+                    write_block(data_encoder, MakeCompressedFrame(data.data(), data.size()));
+                    position += data.size();
                 }
-                stream << word;
+                write_block(data_encoder, MakeEndFrame(file_size));
+                file.coded_size = writer.Offset() - file.offset;
+                continue;
             }
-            start_pos = end_pos;
         }
-        // Writing remaining data (if we need)
-        if (start_pos < bits.size()) {
-            while (bits.size() - start_pos != word_) {
-                bits.emplace_back(false);
-            }
 
-            for (uint8_t bit = 0; bit < extra_bits; bit++) {
-                auto shift = (uint16_t) pow(2, bit);
-                bits.emplace(bits.begin() + start_pos + shift - 1, false);
-            }
+        // Header and data are one bitstream, codewords may contain bits of both (if data has no word of its own)
+        auto file_header = MakeFileHeader(file, revision);
+        if (file.word) write_block(encoder, file_header);
+        else data_encoder.Update(file_header.data(), file_header.size(), coded);
+        data_encoder.Update(first_part.data(), first_part.size(), coded);
+        for (uint64_t position = first_part.size(); position < file_size;) {
+            auto data = next_part();
+            data_encoder.Update(data.data(), data.size(), coded);
+            write_coded();
+            position += data.size();
+        }
+        data_encoder.Finish(coded);
+        write_coded();
+    }
+}
 
-            uint16_t end_pos = start_pos + word_ + extra_bits;
-            for (uint8_t bit = 0; bit < extra_bits; bit++) {
-                auto shift = (uint16_t) pow(2, bit);
-                uint8_t extra_bit = '\0';
-                for (uint16_t pos = start_pos + shift - 1; pos < end_pos; pos += 2 * shift) {
-                    for (auto i = 0; (pos + i < end_pos) && (i < shift); i++) {
-                        extra_bit ^= bits[pos + i];
-                    }
+/*
+ * Same blocks as WriteFiles, but files are opened, read and coded by threads workers. Block is split into chunks
+ * of whole slices (word_ bytes of data are 8 codewords, which are exactly code length bytes, slice is 8 groups),
+ * so every chunk is coded independently: small file is one chunk, large file is many of them. Frames of compressed
+ * file are coded independently too. Coded chunks are written by writer in order of table, so result is the same
+ * as of WriteFiles and output may be a pipe
+ */
+void WriteFilesParallel(const std::vector<InputFile>& files, std::vector<IncludedFile>& table,
+                        BufferedWriter& writer, const uint16_t word_, HafRevision revision, BlockLayout layout,
+                        unsigned threads, bool compress) {
+    auto chunk_bytes_of = [](uint16_t word) -> uint64_t {
+        uint64_t group_bytes = GroupDataBytes(word);
+        return std::max<uint64_t>(1, IoBufferSize() / (SLICE_GROUPS * group_bytes)) * SLICE_GROUPS * group_bytes;
+    };
+    const uint64_t chunk_bytes = chunk_bytes_of(word_);
+    const uint64_t frame_chunk_bytes = IoBufferSize();
+
+    struct Chunk {
+        std::future<std::vector<char>> coded;
+        uint64_t bytes;
+        size_t file;
+        bool first;
+        bool last;
+    };
+    ThreadPool pool(threads);
+    // Chunks in flight are limited by number and by bytes, so memory does not depend on size of files,
+    // and many small files are opened at once while the first of them are written
+    std::deque<Chunk> pending;
+    uint64_t pending_bytes = 0;
+    // Offsets and links are set as files are written, offsets of files after compressed ones are moved
+    std::unordered_map<uint64_t, uint64_t> written_offsets;
+    auto write_first = [&]() {
+        Chunk chunk = std::move(pending.front());
+        pending.pop_front();
+        pending_bytes -= chunk.bytes;
+        IncludedFile& file = table[chunk.file];
+        if (chunk.first) {
+            written_offsets[file.offset] = writer.Offset();
+            file.offset = writer.Offset();
+        }
+        std::vector<char> coded;
+        if (file.linked) {
+            file.link = written_offsets.at(file.link);
+            coded = MakeLinkBlock(file, word_);
+        } else {
+            coded = chunk.coded.get();
+        }
+        writer.Write(coded.data(), coded.size());
+        if (chunk.last) file.coded_size = writer.Offset() - file.offset;
+    };
+    auto add_chunk = [&](std::future<std::vector<char>> coded, uint64_t bytes, size_t file, bool first, bool last) {
+        pending.push_back({std::move(coded), bytes, file, first, last});
+        pending_bytes += bytes;
+        while (pending.size() >= 4 * threads || pending_bytes >= 2 * threads * chunk_bytes) {
+            write_first();
+        }
+    };
+
+    auto read_part = [](const std::string& path, uint64_t offset, char* data, uint64_t size) {
+        FileDescriptor input(path, O_RDONLY);
+        if (ReadAt(input.Get(), data, size, offset) != size)
+            throw std::runtime_error("Unexpected end of " + path);
+    };
+    auto code_block = [=](uint16_t word, const std::vector<char>& data, std::vector<char>& coded) {
+        HammingEncoder encoder(word, layout);
+        encoder.Update(data.data(), data.size(), coded);
+        encoder.Finish(coded);
+    };
+    // Frame of compressed file with its header block before the first chunk and the last frame after the last one
+    auto code_frame = [=](const IncludedFile* file, uint64_t begin, uint64_t size, const std::vector<char>& frame) {
+        uint16_t data_word = file->word ? file->word : word_;
+        std::vector<char> coded;
+        if (begin == 0) code_block(word_, MakeFileHeader(*file, revision), coded);
+        code_block(data_word, frame, coded);
+        if (begin + size == file->size) code_block(data_word, MakeEndFrame(file->size), coded);
+        return coded;
+    };
+    // Chunk of block of header and data, or of block of data after block of header if file has its own word
+    auto code_block_chunk = [=](const IncludedFile* file, const std::string* path, uint64_t begin, uint64_t size) {
+        thread_local std::vector<char> data;
+        data.resize(size);
+        std::vector<char> coded;
+
+        // Chunk may start with the end of file header
+        auto file_header = MakeFileHeader(*file, revision);
+        if (file->word) {
+            if (begin == 0) code_block(word_, file_header, coded);
+            file_header.clear();
+        }
+        uint64_t header_end = std::min<uint64_t>(file_header.size(), begin + size);
+        uint64_t copied = 0;
+        if (begin < header_end) {
+            copied = header_end - begin;
+            std::copy(file_header.begin() + begin, file_header.begin() + header_end, data.begin());
+        }
+        if (copied < size) read_part(*path, begin + copied - file_header.size(), data.data() + copied, size - copied);
+
+        uint16_t data_word = file->word ? file->word : word_;
+        HammingEncoder encoder(data_word, layout, begin / GroupDataBytes(data_word));
+        encoder.Update(data.data(), data.size(), coded);
+        encoder.Finish(coded);
+        return coded;
+    };
+
+    for (size_t i = 0; i < files.size(); i++) {
+        const IncludedFile* file = &table[i];
+        const std::string* path = &files[i].path;
+        if (file->linked) {
+            // Link is known only when block it links to is written
+            add_chunk(std::future<std::vector<char>>(), 0, i, true, true);
+            continue;
+        }
+        // Block of data of file with its own word is empty for empty file, but block of header is its chunk
+        uint64_t block_bytes = (file->word ? 0 : IncludedFileHeaderSize(file->name, revision)) + file->size;
+
+        if (compress && file->size > 0) {
+            uint64_t first_size = std::min(frame_chunk_bytes, file->size);
+            auto first_frame = [=]() {
+                std::vector<char> data(first_size);
+                read_part(*path, 0, data.data(), first_size);
+                return MakeCompressedFrame(data.data(), first_size);
+            };
+            if (first_size == file->size) {
+                // File of one chunk is coded by one worker as frames or as block. Entry of file is not used
+                // by this thread until the chunk is written
+                add_chunk(pool.Submit([=, &table]() {
+                    auto frame = first_frame();
+                    if (!FramesAreSmaller(*file, frame.size(), word_)) return code_block_chunk(file, path, 0,
+                                                                                               block_bytes);
+                    table[i].compressed = true;
+                    return code_frame(file, 0, first_size, frame);
+                }), first_size, i, true, true);
+                continue;
+            }
+            // The other chunks of large file are coded after the first one shows if frames are smaller
+            auto frame = pool.Submit(first_frame).get();
+            if (FramesAreSmaller(*file, frame.size(), word_)) {
+                table[i].compressed = true;
+                add_chunk(pool.Submit([=]() { return code_frame(file, 0, first_size, frame); }), first_size, i, true,
+                          false);
+                for (uint64_t begin = first_size; begin < file->size; begin += frame_chunk_bytes) {
+                    uint64_t size = std::min(frame_chunk_bytes, file->size - begin);
+                    add_chunk(pool.Submit([=]() {
+                        thread_local std::vector<char> data;
+                        data.resize(size);
+                        read_part(*path, begin, data.data(), size);
+                        return code_frame(file, begin, size, MakeCompressedFrame(data.data(), size));
+                    }), size, i, false, begin + size == file->size);
                 }
-                bits[start_pos + shift - 1] = extra_bit;
+                continue;
             }
         }
-        while (!bits.empty()) {
-            char word = '\0';
-            for (auto i = 0; i < CHAR_BIT; i++) {
-                if (!bits.empty() && bits[0]) word++;
-                if (!bits.empty()) bits.erase(bits.begin());
-                if (i != CHAR_BIT - 1) word <<= 1;
-            }
-            stream << word;
+
+        const uint64_t data_chunk_bytes = chunk_bytes_of(file->word ? file->word : word_);
+        for (uint64_t begin = 0; begin == 0 || begin < block_bytes; begin += data_chunk_bytes) {
+            uint64_t size = std::min(data_chunk_bytes, block_bytes - begin);
+            add_chunk(pool.Submit([=]() { return code_block_chunk(file, path, begin, size); }), size, i, begin == 0,
+                      begin + size == block_bytes);
         }
     }
+    while (!pending.empty()) {
+        write_first();
+    }
 }
 
-void CreateHaf(const std::string& output_filename, std::vector<std::string>& args, const uint8_t word_,
-               const std::string& filename_end) {
+void CreateHaf(const std::string& output_filename, std::vector<std::string>& args, uint16_t word_,
+               const std::string& filename_end, unsigned threads, BlockLayout layout, bool dedup, bool compress,
+               std::optional<ErrorTarget> target) {
 
     /*
-     * Structure of primary Haf consists of 2 parts: header and data
-     * Header: [type_code][total_size][n_files][word_length] (total 11 bytes without coding, 15 with 11-bit coding)
-     * coding_type - 2B, total_size - 4B, files_number - 4B, word_length - 1B
+     * Structure of primary Haf consists of 3 parts: header, data and directory
+     * Header: [type_code][total_size][n_files][word_length][layout][reserved] (total 22 bytes without coding,
+     * 30 with 11-bit coding)
+     * coding_type - 2B ("HC"), total_size - 8B, files_number - 8B, word_length - 1B, layout - 1B (1 if codewords
+     * of files are interleaved, described in hamming.h), profile - 1B (1 if word_length is data bits of aligned
+     * profile, described in hamming.h), reserved - 1B
      * Header coding with 11-bit word length for unique decoding, other code - with arbitrary word length
      * Data: n files of structure [file_name_size][file_name][file_size][file_data] (unknown size)
-     * file_name_size - 1B, file_name < 255B, file_size - 32B, file_data - unknown size
+     * file_name_size - 1B, file_name < 255B, file_size - 8B, file_data - unknown size
+     * Name of file is its path from included directory with '/' separators ("dir/sub/file"). Name longer than 255B
+     * is [0][long_file_name_size][file_name], long_file_name_size - 2B
+     * Directory: offsets of files after the data (described in directory.h)
+     *
+     * File of unknown size (pipe or device) has STREAMED_FILE_FLAG instead of file_size and is coded as blocks:
+     * [file_name_size][file_name][file_size], frames [chunk_size][chunk] (chunk_size - 4B, chunk < 4GB) and
+     * the last frame [0][file_size] (4B of 0 and 8B of size). If Haf is written to pipe, its total_size is 0,
+     * Haf ends at the end of file
+     *
+     * File with the same data as earlier file (if Haf is created with dedup) has LINKED_FILE_FLAG in file_size
+     * and is coded as block [file_name_size][file_name][file_size][link], link - 8B offset of block of the first
+     * file with this data
+     *
+     * File compressed by built-in LZ compression (if Haf is created with compress and it makes file smaller) has
+     * COMPRESSED_FILE_FLAG in file_size, which is size of its data, and is coded by frames like streamed file.
+     * Frame of chunk which is smaller after compression is [frame_size][chunk_size][compressed_chunk], frame_size
+     * has COMPRESSED_FRAME_FLAG, it is 4B more than size of compressed_chunk (format described in lz.h)
+     *
+     * File whose data is coded with its own word (if Haf is created for target error rate) has OWN_WORD_FILE_FLAG
+     * in file_size and is coded as block [file_name_size][file_name][file_size][word] (word - 2B, as in header
+     * of Haf) and then block [file_data] or frames coded with word. word_length of Haf is word of headers then
+     *
+     * Old revisions have 32-bit sizes: header is [type_code][total_size][n_files][word_length]
+     * (11 bytes without coding, 15 with coding) and file_size is 4B. "HA" is Haf without directory,
+     * "HB" is Haf with directory
      */
 
-    auto output_file = std::ofstream(output_filename, std::ios::binary);
-    if (!output_file.is_open()) {
-        throw std::runtime_error("Failed to open " + output_filename);
+    if (threads == 0) {
+        throw std::runtime_error("Number of threads must be positive");
     }
+    CheckWordLayout(word_, layout);
 
-    uint32_t primary_files_size = 0;
-    uint32_t total_data_size = 0;
-    for (const auto& filename: args) {
-        if (!std::filesystem::is_regular_file(filename + filename_end))
-            throw std::runtime_error("File [" + filename += filename_end + "] does not exist");
-
-        primary_files_size += std::filesystem::file_size(filename + filename_end);
-
-        uint8_t filename_size = filename.size();
-        if (filename.find_last_of("/\\") != std::string::npos) filename_size -= filename.find_last_of("/\\") + 1;
-        uint32_t file_size = INCLUDED_FILE_NAME_SIZE + filename_size +
-                             INCLUDED_FILE_SIZE + std::filesystem::file_size(filename + filename_end);
-        auto words_count = (uint32_t) std::ceil((double) (CHAR_BIT * file_size) / word_);
-        total_data_size += std::ceil((double) (words_count * (word_ + CountAddedBits(word_))) / CHAR_BIT);
+    auto files = ListInputFiles(args, filename_end);
+    auto table = MakeFilesTable(files, word_, WIDE_HEADER_SIZE, HafRevision::Wide, layout, threads);
+    if (target) word_ = ChooseFileWords(table, *target, layout, compress);
+    uint64_t linked_files = dedup ? LinkDuplicateFiles(files, table, word_, threads) : 0;
+    bool streamed = std::any_of(table.begin(), table.end(), [](const IncludedFile& file) { return file.streamed; });
+    // Sizes of compressed files are known only after writing, like sizes of streamed ones
+    bool sized_after_writing = streamed || compress;
+    uint64_t primary_files_size = 0;
+    for (const auto& file: table) {
+        primary_files_size += file.size;
     }
+    uint64_t data_end = table.empty() ? WIDE_HEADER_SIZE : table.back().offset + table.back().coded_size;
+    auto directory = MakeDirectory(table);
 
-    uint32_t total_haf_size = HEADER_SIZE + total_data_size;
-    uint32_t files_number = args.size();
+    uint64_t total_haf_size = data_end + directory.size();
+    uint64_t files_number = files.size();
     std::cout << "Creating Haf \"" << output_filename << "\"\n";
     std::cout << "Primary files size: " << primary_files_size << "B\n";
-    std::cout << "Total theoretical size: " << total_haf_size << "B\n";
-
-    std::vector<char> header;
-    header.push_back('H');
-    header.push_back('A');
-    header.insert(header.end(),
-                  (char*) &total_haf_size,
-                  (char*) &total_haf_size + sizeof(total_haf_size));
-    header.insert(header.end(),
-                  (char*) &files_number,
-                  (char*) &files_number + sizeof(files_number));
-    header.insert(header.end(),
-                  (char*) &word_,
-                  (char*) &word_ + sizeof(word_));
-
-    WriteHeader(header, output_file);
-    WriteFiles(args, output_file, word_, filename_end);
-    output_file.close();
-
-    std::cout << "Result size: " << std::filesystem::file_size(output_filename) << "B\n";
-}
-
-// Checks that file is Haf and returns archive size, number of included files and word length
-std::tuple<uint32_t, uint32_t, uint8_t> ReadHeader(std::ifstream& stream) {
-    const auto extra_bits = CountAddedBits(DEFAULT_LENGTH);
-    std::vector<bool> bits;
-    std::vector<char> data;
-    char byte = '\0';
-    uint16_t start_pos = 0;
-    uint16_t bytes_read = 0;
-    while (bytes_read < HEADER_SIZE && stream.get(byte)) {
-        bytes_read++;
-
-        // Writing necessary bits
-        for (auto j = 0; j < CHAR_BIT; j++) {
-            bits.emplace_back(byte & 0b10000000);
-            byte <<= 1;
-        }
-        if (bits.size() - start_pos < DEFAULT_LENGTH + extra_bits) continue;
-
-        // Checking errors and removing bits
-        uint16_t end_pos = start_pos + DEFAULT_LENGTH + extra_bits;
-        uint32_t wrong_bit = 0;
-        for (uint8_t bit = 0; bit < extra_bits; bit++) {
-            auto shift = (uint16_t) pow(2, bit);
-            uint8_t extra_bit = '\0';
-            for (uint16_t pos = start_pos + shift - 1 - bit; pos < end_pos - bit; pos += 2 * shift) {
-                for (auto i = 0; (pos + i < end_pos) && (i < shift); i++) {
-                    extra_bit ^= bits[pos + i];
-                }
-            }
-            if (extra_bit) {
-                wrong_bit += shift;
-            }
-            bits.erase(bits.begin() + start_pos + shift - 1 - bit);
-        }
-        end_pos -= extra_bits;
-        if (wrong_bit) {
-            bits[start_pos + wrong_bit - CountAddedBits(wrong_bit)] = !bits[start_pos + wrong_bit -
-                                                                            CountAddedBits(wrong_bit)];
-        }
-
-        // Writing decoding data
-        while (end_pos >= CHAR_BIT) {
-            end_pos -= CHAR_BIT;
-            char word = '\0';
-            for (auto i = 0; i < CHAR_BIT; i++) {
-                if (bits[0]) word++;
-                bits.erase(bits.begin());
-                if (i != CHAR_BIT - 1) word <<= 1;
-            }
-            data.emplace_back(word);
+    if (dedup) std::cout << "Files linked to files with the same data: " << linked_files << "\n";
+    if (target) {
+        std::map<uint16_t, uint64_t> data_words;
+        for (const auto& file: table) {
+            if (!file.linked) data_words[file.word ? file.word : word_]++;
+        }
+        std::cout << "Headers coded with word: " << WordName(word_) << "\n";
+        std::cout << "Data coded with words:";
+        for (const auto& [data_word, number]: data_words) {
+            std::cout << " " << WordName(data_word) << " (" << number << (number == 1 ? " file)" : " files)");
         }
-        start_pos = end_pos;
+        std::cout << "\n";
     }
-    // Ignore remaining bits, they are zeros
+    if (streamed) std::cout << "Total theoretical size: unknown, some files are read from pipes\n";
+    else if (compress) std::cout << "Total theoretical size: at most " << total_haf_size << "B\n";
+    else std::cout << "Total theoretical size: " << total_haf_size << "B\n";
+
+    // Output is opened after files are checked, so it is kept if Haf can't be created
+    FileDescriptor output(output_filename, O_WRONLY | O_CREAT | O_TRUNC);
+    BufferedWriter writer(output.Get(), 0);
+    // Haf with streamed or compressed files gets its size after writing, header is written again if output
+    // is not a pipe
+    WriteHeader(MakeHeader(sized_after_writing ? 0 : total_haf_size, files_number, word_, HafRevision::Wide, layout),
+                writer);
+    if (threads > 1 && !streamed)
+        WriteFilesParallel(files, table, writer, word_, HafRevision::Wide, layout, threads, compress);
+    else WriteFiles(files, table, writer, word_, HafRevision::Wide, layout, compress);
+    if (sized_after_writing) {
+        directory = MakeDirectory(table);
+        total_haf_size = writer.Offset() + directory.size();
+    }
+    writer.Write(directory.data(), directory.size());
+    if (sized_after_writing && writer.Seekable()) {
+        writer.Seek(0);
+        WriteHeader(MakeHeader(total_haf_size, files_number, word_, HafRevision::Wide, layout), writer);
+    }
+    writer.Flush();
+
+    std::cout << "Result size: " << total_haf_size << "B\n";
+}
+
+// Checks that file is Haf and returns archive size, number of included files, word length, revision of Haf
+// and layout of its codewords
+std::tuple<uint64_t, uint64_t, uint16_t, HafRevision, BlockLayout> ReadHeader(const FileReader& reader) {
+    // The first 11 bytes of all revisions are whole codewords, so type code is decoded before the rest
+    std::vector<char> buffer;
+    auto coded = reader.Read(0, WIDE_HEADER_SIZE, buffer);
+    if (coded.size() < HEADER_SIZE)
+        throw std::logic_error("Trying to open not a Haf");
+    std::vector<char> data;
+    HammingDecoder(DEFAULT_LENGTH, HEADER_SIZE_WITHOUT_CODING).Update(coded.data(), HEADER_SIZE, data);
 
     // File type - 2B (0 - 1st position in data)
     std::string file_type(data.begin(), data.begin() + 2);
-    if (file_type != "HA")
+    if (file_type == "HA" || file_type == "HB") {
+        // File size - 4B (2 - 5th position in data)
+        uint32_t haf_size = *reinterpret_cast<uint32_t*>(&data[2]);
+        // Files number - 4B (6 - 9th position in data)
+        uint32_t files_number = *reinterpret_cast<uint32_t*>(&data[6]);
+        // Word length - 1B (10th position in data)
+        uint8_t word_length = *reinterpret_cast<uint8_t*>(&data[10]);
+        return {haf_size, files_number, word_length, file_type == "HA" ? HafRevision::Legacy : HafRevision::Directory,
+                BlockLayout::Packed};
+    }
+    if (file_type != "HC")
+        throw std::logic_error("Trying to open not a Haf");
+
+    if (coded.size() != WIDE_HEADER_SIZE)
         throw std::logic_error("Trying to open not a Haf");
+    data.clear();
+    HammingDecoder(DEFAULT_LENGTH, WIDE_HEADER_SIZE_WITHOUT_CODING).Update(coded.data(), WIDE_HEADER_SIZE, data);
+    uint64_t haf_size;
+    uint64_t files_number;
+    // File size - 8B (2 - 9th position in data), files number - 8B (10 - 17th), word length - 1B (18th),
+    // layout - 1B (19th), profile - 1B (20th)
+    std::memcpy(&haf_size, &data[2], sizeof(haf_size));
+    std::memcpy(&files_number, &data[10], sizeof(files_number));
+    uint16_t word_length = (uint8_t) data[18] | (uint16_t) ((uint8_t) data[20] << 8);
+    if (!IsValidWord(word_length))
+        throw std::runtime_error("Unknown word of Haf");
+    if ((uint8_t) data[19] > 1 || ((word_length & ALIGNED_PROFILE_FLAG) && data[19]))
+        throw std::runtime_error("Unknown layout of codewords of Haf");
+    // Haf written to pipe ends at the end of file
+    if (haf_size == 0) haf_size = reader.Size();
+    return {haf_size, files_number, word_length, HafRevision::Wide,
+            data[19] ? BlockLayout::Interleaved : BlockLayout::Packed};
+}
+
+// Decodes data_bytes of the beginning of block at offset, block_bytes gives size of block by decoded prefix (which
+// may be longer than data_bytes). Check fields of aligned profiles follow data of their group, so the last group with
+// prefix may be cut by the end of block: of its sizes which agree with size of block the one with the fewest errors
+// of codewords is taken
+std::vector<char> DecodePrefix(const FileReader& reader, uint64_t offset, uint64_t data_bytes, uint16_t word_,
+                               const std::function<uint64_t(const std::vector<char>&)>& block_bytes) {
+    std::vector<char> buffer;
+    std::vector<char> data;
+    if (!(word_ & ALIGNED_PROFILE_FLAG)) {
+        auto need_bytes = EncodedSize(word_, data_bytes);
+        auto coded = reader.Read(offset, need_bytes, buffer);
+        if (coded.size() != need_bytes)
+            throw std::runtime_error("Unexpected end of Haf");
+        HammingDecoder(word_, data_bytes).Update(coded.data(), need_bytes, data);
+        return data;
+    }
+    const auto& code = GetHammingCode(word_);
+    const uint64_t groups_bytes = (data_bytes + code.word - 1) / code.word * code.word;
+    std::vector<char> best;
+    uint64_t best_errors = UINT64_MAX;
+    for (uint64_t decoded_bytes = groups_bytes; decoded_bytes >= data_bytes && best_errors; decoded_bytes--) {
+        auto need_bytes = EncodedSize(word_, decoded_bytes);
+        auto coded = reader.Read(offset, need_bytes, buffer);
+        if (coded.size() != need_bytes) continue;
+        data.clear();
+        HammingDecoder(word_, decoded_bytes).Update(coded.data(), need_bytes, data);
+        if (std::min(block_bytes(data), groups_bytes) != decoded_bytes) continue;
+        CodewordErrors errors;
+        CheckBlockCodewords(code, reinterpret_cast<const uint8_t*>(coded.data()), decoded_bytes, 0,
+                            SliceBegin(word_, BlockLayout::Packed), errors);
+        if (errors.corrected + errors.uncorrectable < best_errors) {
+            best_errors = errors.corrected + errors.uncorrectable;
+            best.assign(data.begin(), data.begin() + data_bytes);
+        }
+    }
+    if (best_errors == UINT64_MAX)
+        throw std::runtime_error("Block of Haf is damaged");
+    return best;
+}
+
+// Reads header of included file whose block starts at offset
+IncludedFile ReadFileHeader(const FileReader& reader, uint64_t offset, uint16_t word_, HafRevision revision) {
+    // Header is the beginning of coded block, so it is decoded by prefix of block: first name size, then all
+    auto header_block_bytes = [revision](const std::vector<char>& prefix) -> uint64_t {
+        auto [name_field_size, name_size] = FileNameSize(prefix.data());
+        uint64_t header_size = IncludedFileHeaderSize(std::string(name_size, '\0'), revision);
+        // Block is not shorter than its header
+        if (prefix.size() < header_size) return header_size;
+        uint64_t file_size = 0;
+        std::memcpy(&file_size, &prefix[name_field_size], header_size - name_field_size);
+        if (revision != HafRevision::Wide) return header_size + file_size;
+        // Header of streamed or compressed file or file with its own word is a block itself
+        if (file_size & OWN_WORD_FILE_FLAG) return header_size + FILE_WORD_SIZE;
+        if (file_size & (STREAMED_FILE_FLAG | COMPRESSED_FILE_FLAG)) return header_size;
+        if (file_size & LINKED_FILE_FLAG) return header_size + LINK_OFFSET_SIZE;
+        return header_size + (file_size & ~DELETED_FILE_FLAG);
+    };
+    // Any header is longer than size of long name
+    auto size_prefix = DecodePrefix(reader, offset, INCLUDED_FILE_NAME_SIZE + LONG_FILE_NAME_SIZE, word_,
+                                    header_block_bytes);
+    auto [name_field_size, filename_size] = FileNameSize(size_prefix.data());
+    std::string filename(filename_size, '\0');
+    auto data = DecodePrefix(reader, offset, IncludedFileHeaderSize(filename, revision), word_, header_block_bytes);
+    if (FileNameSize(data.data()).second != filename_size)
+        throw std::runtime_error("Block of Haf is damaged");
+    filename.assign(data.begin() + (name_field_size - filename_size), data.begin() + name_field_size);
+    // Little-endian size of 4 or 8 bytes
+    uint64_t file_size = 0;
+    std::memcpy(&file_size, &data[name_field_size], data.size() - name_field_size);
+    IncludedFile file{std::move(filename), file_size, offset, 0};
+    bool own_word = false;
+    if (revision == HafRevision::Wide) {
+        file.deleted = file.size & DELETED_FILE_FLAG;
+        file.streamed = file.size & STREAMED_FILE_FLAG;
+        file.linked = file.size & LINKED_FILE_FLAG;
+        file.compressed = file.size & COMPRESSED_FILE_FLAG;
+        own_word = file.size & OWN_WORD_FILE_FLAG;
+        file.size &= ~(DELETED_FILE_FLAG | STREAMED_FILE_FLAG | LINKED_FILE_FLAG | COMPRESSED_FILE_FLAG |
+                       OWN_WORD_FILE_FLAG);
+    }
+    if (own_word) {
+        // Word of data follows header in its block
+        data = DecodePrefix(reader, offset, data.size() + FILE_WORD_SIZE, word_, header_block_bytes);
+        std::memcpy(&file.word, &data[data.size() - FILE_WORD_SIZE], FILE_WORD_SIZE);
+        if (!IsValidWord(file.word))
+            throw std::runtime_error("Word of file " + file.name + " is damaged");
+    }
+    if (file.linked) {
+        // Link follows header in the same block and leads to one of previous blocks
+        data = DecodePrefix(reader, offset, data.size() + LINK_OFFSET_SIZE, word_, header_block_bytes);
+        std::memcpy(&file.link, &data[data.size() - LINK_OFFSET_SIZE], LINK_OFFSET_SIZE);
+        if (file.link >= offset)
+            throw std::runtime_error("Link of file " + file.name + " is damaged");
+    }
+    // Size of streamed file and size of frames of streamed or compressed file are found by ReadFrames
+    file.coded_size = FileCodedSize(file, word_, revision);
+    return file;
+}
 
-    // File size - 4B (2 - 5th position in data)
-    uint32_t haf_size = *reinterpret_cast<uint32_t*>(&data[2]);
-    // Files number - 4B (6 - 9th position in data)
-    uint32_t files_number = *reinterpret_cast<uint32_t*>(&data[6]);
-    // Word length - 1B (10th position in data)
-    uint8_t word_length = *reinterpret_cast<uint8_t*>(&data[10]);
+// Finds included files by their headers, data is skipped: blocks of files are coded independently,
+// so size of every block is known from its header
+std::vector<IncludedFile> ScanFilesTable(const FileReader& reader, uint64_t files_number, uint16_t word_,
+                                         HafRevision revision) {
+    std::vector<IncludedFile> files;
+    uint64_t offset = HafHeaderSize(revision);
+    for (uint64_t file_read = 0; file_read < files_number; file_read++) {
+        auto file = ReadFileHeader(reader, offset, word_, revision);
+        if (file.streamed || file.compressed) {
+            auto [frames_size, file_size] = ReadFrames(reader, offset + file.coded_size, file.word ? file.word : word_,
+                                                       nullptr);
+            if (file.compressed && file_size != file.size)
+                throw std::runtime_error("Frames of compressed file are damaged, their size differs from size of file");
+            file.coded_size += frames_size;
+            file.size = file_size;
+        }
+        offset += file.coded_size;
+        files.push_back(std::move(file));
+    }
+    return files;
+}
 
-    return {haf_size, files_number, word_length};
+void ReadLinks(const FileReader& reader, std::vector<IncludedFile>& files, uint16_t word_, HafRevision revision) {
+    for (auto& file: files) {
+        if (file.linked) file.link = ReadFileHeader(reader, file.offset, word_, revision).link;
+    }
 }
 
-std::vector<std::pair<std::string, uint32_t>> HafFilesList(const std::string& ha_file) {
-    std::vector<std::pair<std::string, uint32_t>> files;
-    auto input_stream = std::ifstream(ha_file, std::ios::binary);
-    if (!input_stream.is_open()) {
-        throw std::runtime_error("Failed to open " + ha_file);
+std::vector<IncludedFile> ReadFilesTable(const FileReader& reader, uint64_t haf_size, uint64_t files_number,
+                                         uint16_t word_, HafRevision revision) {
+    // Directory at the end of pipe can't be read before files
+    if (revision != HafRevision::Legacy && reader.Seekable()) {
+        auto files = ReadDirectory(reader, haf_size, files_number, HafHeaderSize(revision));
+        if (files) {
+            ReadLinks(reader, *files, word_, revision);
+            return *files;
+        }
+        std::cout << "Directory of Haf is damaged, searching files by their headers\n";
     }
-    uint32_t haf_size;
-    uint32_t files_number;
-    uint8_t word_;
+    return ScanFilesTable(reader, files_number, word_, revision);
+}
+
+std::vector<std::pair<std::string, uint64_t>> HafFilesList(const std::string& ha_file) {
+    std::vector<std::pair<std::string, uint64_t>> files;
+    FileReader reader(ha_file);
+    uint64_t haf_size;
+    uint64_t files_number;
+    uint16_t word_;
+    HafRevision revision;
+    BlockLayout layout;
     std::cout << "Reading Haf \"" << ha_file << "\"\n";
-    std::tie(haf_size, files_number, word_) = ReadHeader(input_stream);
+    std::tie(haf_size, files_number, word_, revision, layout) = ReadHeader(reader);
     std::cout << "Archive size: " << haf_size << "B\n";
     std::cout << "Files number: " << files_number << "\n";
-    std::cout << "Coded with word: " << (uint16_t) word_ << "bit\n";
-
-    // Reading such as header, but with skipping bytes with data
-    const auto extra_bits = CountAddedBits(word_);
-    for (uint32_t file_read = 0; file_read < files_number; file_read++) {
-        uint32_t start_pos = 0;
-        char byte;
-        std::vector<bool> bits;
-        std::vector<char> data;
-        uint32_t need_bytes = INCLUDED_FILE_NAME_SIZE;
-        uint32_t written_bytes = 0;
-        while (input_stream.get(byte)) {
-            for (auto j = 0; j < CHAR_BIT; j++) {
-                bits.emplace_back(byte & 0b10000000);
-                byte <<= 1;
-            }
-            if (bits.size() - start_pos < word_ + extra_bits) continue;
-
-            uint32_t end_pos = start_pos + word_ + extra_bits;
-            uint32_t wrong_bit = 0;
-            for (uint8_t bit = 0; bit < extra_bits; bit++) {
-                auto shift = (uint16_t) pow(2, bit);
-                uint8_t extra_bit = '\0';
-                for (uint32_t pos = start_pos + shift - 1 - bit; pos < end_pos - bit; pos += 2 * shift) {
-                    for (auto i = 0; (pos + i < end_pos) && (i < shift); i++) {
-                        extra_bit ^= bits[pos + i];
-                    }
-                }
-                if (extra_bit) {
-                    wrong_bit += shift;
-                }
-                bits.erase(bits.begin() + start_pos + shift - 1 - bit);
-            }
-            end_pos -= extra_bits;
-            if (wrong_bit) {
-                bits[start_pos + wrong_bit - CountAddedBits(wrong_bit)] = !bits[start_pos + wrong_bit -
-                                                                                CountAddedBits(wrong_bit)];
-            }
+    std::cout << "Coded with word: " << WordName(word_) << "\n";
+    if (layout == BlockLayout::Interleaved) std::cout << "Codewords are interleaved by slices of 64\n";
 
-            while (end_pos >= CHAR_BIT) {
-                end_pos -= CHAR_BIT;
-                char word = '\0';
-                for (auto i = 0; i < CHAR_BIT; i++) {
-                    if (bits[0]) word++;
-                    bits.erase(bits.begin());
-                    if (i != CHAR_BIT - 1) word <<= 1;
-                }
-                data.emplace_back(word);
-                written_bytes++;
-                if (written_bytes == need_bytes) break;
-            }
-            start_pos = end_pos;
-            if (data.size() == INCLUDED_FILE_NAME_SIZE) {
-                need_bytes += data[0] + INCLUDED_FILE_SIZE;
-            } else if (written_bytes == need_bytes) break;
+    uint64_t deleted_files = 0;
+    uint64_t linked_files = 0;
+    uint64_t own_word_files = 0;
+    for (auto& file: ReadFilesTable(reader, haf_size, files_number, word_, revision)) {
+        if (file.deleted) {
+            deleted_files++;
+            continue;
+        }
+        if (file.linked) linked_files++;
+        if (file.word) own_word_files++;
+        files.emplace_back(std::move(file.name), file.size);
+    }
+    if (deleted_files) std::cout << "Files marked deleted: " << deleted_files << "\n";
+    if (linked_files) std::cout << "Files linked to files with the same data: " << linked_files << "\n";
+    if (own_word_files) std::cout << "Files with data coded with their own words: " << own_word_files << "\n";
+    return files;
+}
+
+// Decodes coded block of data_bytes from offset by parts, the first skipped_bytes of data are not passed to consume.
+// Returns coded size of block
+uint64_t DecodeBlock(const FileReader& reader, uint64_t offset, uint64_t data_bytes, uint16_t word_,
+                     BlockLayout layout, uint64_t skipped_bytes,
+                     const std::function<void(const char*, size_t)>& consume) {
+    uint64_t coded_size = EncodedSize(word_, data_bytes);
+    std::vector<char> data;
+    HammingDecoder decoder(word_, data_bytes, layout);
+    // Decoded data is written by parts, coded bytes are taken from mapping without copying or read ahead
+    SequentialReader coded_input(reader, offset, coded_size);
+    for (uint64_t position = 0; position < coded_size;) {
+        auto coded = coded_input.Next();
+        if (coded.empty())
+            throw std::runtime_error("Unexpected end of Haf");
+        decoder.Update(coded.data(), coded.size(), data);
+        auto skipped = std::min<uint64_t>(skipped_bytes, data.size());
+        skipped_bytes -= skipped;
+        consume(data.data() + skipped, data.size() - skipped);
+        data.clear();
+        position += coded.size();
+    }
+    return coded_size;
+}
+
+// Walks frames of streamed or compressed file from offset, frame is called (if it is set) with offset and size
+// of every frame with data. Returns coded size of frames and size of file. Sizes of frames are in packed prefix
+// of frames of any layout
+std::pair<uint64_t, uint64_t> ReadFrames(const FileReader& reader, uint64_t offset, uint16_t word_,
+                                         const std::function<void(uint64_t, uint64_t, bool)>& frame) {
+    // Frame is [chunk_size][chunk] or [frame_size][chunk_size][compressed_chunk], the last one is [0][file_size]
+    auto frame_bytes = [](const std::vector<char>& data) -> uint64_t {
+        uint32_t chunk_size;
+        std::memcpy(&chunk_size, data.data(), sizeof(chunk_size));
+        return FRAME_SIZE_SIZE + (chunk_size ? chunk_size & ~COMPRESSED_FRAME_FLAG : WIDE_INCLUDED_FILE_SIZE);
+    };
+    auto decode_prefix = [&](uint64_t position, uint64_t data_bytes) {
+        return DecodePrefix(reader, position, data_bytes, word_, frame_bytes);
+    };
+
+    uint64_t position = offset;
+    uint64_t file_size = 0;
+    while (true) {
+        uint32_t chunk_size;
+        std::memcpy(&chunk_size, decode_prefix(position, FRAME_SIZE_SIZE).data(), sizeof(chunk_size));
+        if (chunk_size == 0) break;
+        bool compressed = chunk_size & COMPRESSED_FRAME_FLAG;
+        uint32_t frame_size = chunk_size & ~COMPRESSED_FRAME_FLAG;
+        if (compressed) {
+            // Size of chunk follows size of compressed frame
+            auto data = decode_prefix(position, 2 * FRAME_SIZE_SIZE);
+            std::memcpy(&chunk_size, &data[FRAME_SIZE_SIZE], sizeof(chunk_size));
         }
+        if (chunk_size > MAX_IO_BUFFER_SIZE || frame_size > MAX_IO_BUFFER_SIZE ||
+            (compressed && frame_size <= FRAME_SIZE_SIZE))
+            throw std::runtime_error("Frame of file is damaged");
+        if (frame) frame(position, FRAME_SIZE_SIZE + frame_size, compressed);
+        position += EncodedSize(word_, FRAME_SIZE_SIZE + frame_size);
+        file_size += chunk_size;
+    }
 
-        uint32_t bytes_read = std::ceil(
-            std::ceil((double) data.size() * CHAR_BIT / word_) * (word_ + extra_bits) / CHAR_BIT);
-        uint32_t data_bytes = *reinterpret_cast<uint32_t*>(&data[INCLUDED_FILE_NAME_SIZE + data[0]]);
-        files.emplace_back(
-            std::string(data.begin() + INCLUDED_FILE_NAME_SIZE, data.begin() + INCLUDED_FILE_NAME_SIZE + data[0]),
-            data_bytes);
-        uint32_t skipped_bytes = (uint32_t) std::ceil(
-            std::ceil((double) (data.size() + data_bytes) * CHAR_BIT / word_) * (word_ + extra_bits) / CHAR_BIT) -
-                                 bytes_read;
-        input_stream.seekg(skipped_bytes, std::ios_base::cur);
+    // The last frame: [0][file_size]
+    auto data = decode_prefix(position, FRAME_SIZE_SIZE + WIDE_INCLUDED_FILE_SIZE);
+    uint64_t written_size;
+    std::memcpy(&written_size, &data[FRAME_SIZE_SIZE], sizeof(written_size));
+    if (written_size != file_size)
+        throw std::runtime_error("Frames of file are damaged, their size differs from size of file");
+    position += EncodedSize(word_, FRAME_SIZE_SIZE + WIDE_INCLUDED_FILE_SIZE);
+    return {position - offset, file_size};
+}
+
+uint64_t DecodeFile(const FileReader& reader, const IncludedFile& file, uint16_t word_, HafRevision revision,
+                    BlockLayout layout, const std::function<void(const char*, size_t)>& consume) {
+    if (file.linked) {
+        // Data is taken from block of the file with the same data, it is the first of them, so it is not linked
+        auto target = ReadFileHeader(reader, file.link, word_, revision);
+        if (target.streamed || target.linked || target.size != file.size)
+            throw std::runtime_error("Link of file " + file.name + " is damaged");
+        if (consume) DecodeFile(reader, target, word_, revision, layout, consume);
+        return file.coded_size;
     }
+    // Header is decoded again as the beginning of the block and skipped
+    uint64_t header_size = IncludedFileHeaderSize(file.name, revision);
+    reader.AdviseSequential(file.offset, file.coded_size);
+    if (!file.streamed && !file.compressed && !file.word)
+        return DecodeBlock(reader, file.offset, header_size + file.size, word_, layout, header_size, consume);
+    // Other files have block of header, their data is coded with their own words
+    uint64_t header_coded_size = EncodedSize(word_, FileBlockBytes(file, revision));
+    const uint16_t data_word = file.word ? file.word : word_;
+    if (!file.streamed && !file.compressed)
+        return header_coded_size + DecodeBlock(reader, file.offset + header_coded_size, file.size, data_word, layout,
+                                               0, consume);
+    // Compressed frame is decoded whole, then its chunk is decompressed
+    std::vector<char> compressed_frame;
+    std::vector<char> chunk;
+    auto decode_frame = [&](uint64_t offset, uint64_t data_bytes, bool compressed) {
+        if (!compressed) {
+            DecodeBlock(reader, offset, data_bytes, data_word, layout, FRAME_SIZE_SIZE, consume);
+            return;
+        }
+        compressed_frame.clear();
+        DecodeBlock(reader, offset, data_bytes, data_word, layout, FRAME_SIZE_SIZE, [&](const char* data, size_t size) {
+            compressed_frame.insert(compressed_frame.end(), data, data + size);
+        });
+        uint32_t chunk_size;
+        std::memcpy(&chunk_size, compressed_frame.data(), sizeof(chunk_size));
+        chunk.resize(chunk_size);
+        LzDecompress(compressed_frame.data() + FRAME_SIZE_SIZE, compressed_frame.size() - FRAME_SIZE_SIZE,
+                     chunk.data(), chunk.size());
+        consume(chunk.data(), chunk.size());
+    };
+    return header_coded_size + ReadFrames(reader, file.offset + header_coded_size, data_word,
+                                          consume ? decode_frame
+                                                  : std::function<void(uint64_t, uint64_t, bool)>()).first;
+}
 
-    return files;
+// Decodes one included file to output_filename, reader of mapped Haf may be shared by threads extracting files.
+// Missing directories of output_filename are created
+uint64_t ExtractFile(const FileReader& reader, const IncludedFile& file, uint16_t word_, HafRevision revision,
+                     BlockLayout layout, const std::string& output_filename) {
+    auto output_directory = std::filesystem::path(output_filename).parent_path();
+    if (!output_directory.empty()) std::filesystem::create_directories(output_directory);
+    FileDescriptor output(output_filename, O_WRONLY | O_CREAT | O_TRUNC);
+    BufferedWriter writer(output.Get(), 0);
+    auto coded_size = DecodeFile(reader, file, word_, revision, layout,
+                                 [&writer](const char* data, size_t size) { writer.Write(data, size); });
+    writer.Flush();
+    return coded_size;
 }
 
-std::vector<std::string> ExtractHaf(const std::string& ha_file, const std::string& filename_end) {
-    std::vector<std::string> files;
-    auto input_stream = std::ifstream(ha_file, std::ios::binary);
-    if (!input_stream.is_open()) {
-        throw std::runtime_error("Failed to open " + ha_file);
+std::vector<std::string> ExtractHaf(const std::string& ha_file, const std::string& filename_end, unsigned threads,
+                                    const std::vector<std::string>& names, bool to_stdout) {
+    if (threads == 0) {
+        throw std::runtime_error("Number of threads must be positive");
     }
-    uint32_t haf_size;
-    uint32_t files_number;
-    uint8_t word_;
+    std::vector<std::string> files;
+    FileReader reader(ha_file);
+    uint64_t haf_size;
+    uint64_t files_number;
+    uint16_t word_;
+    HafRevision revision;
+    BlockLayout layout;
     std::cout << "Extracting from Haf \"" << ha_file << "\"\n";
-    std::tie(haf_size, files_number, word_) = ReadHeader(input_stream);
+    std::tie(haf_size, files_number, word_, revision, layout) = ReadHeader(reader);
     std::cout << "Archive size: " << haf_size << "B\n";
     std::cout << "Files number: " << files_number << "\n";
-    std::cout << "Coded with word: " << (uint16_t) word_ << "bit\n";
-
-    // Reading such as header, but with skipping bytes with data
-    const auto extra_bits = CountAddedBits(word_);
-    std::ofstream output_stream;
-    for (uint32_t file_read = 0; file_read < files_number; file_read++) {
-        bool reading_header = true;
-        uint32_t start_pos = 0;
-        char byte;
-        std::vector<bool> bits;
-        std::vector<char> data;
-        uint32_t need_bytes = INCLUDED_FILE_NAME_SIZE;
-        uint32_t written_bytes = 0;
-        while (input_stream.get(byte)) {
-            for (auto j = 0; j < CHAR_BIT; j++) {
-                bits.emplace_back(byte & 0b10000000);
-                byte <<= 1;
+    std::cout << "Coded with word: " << WordName(word_) << "\n";
+
+    auto is_wanted = [&](const std::string& name) {
+        return names.empty() || std::find(names.begin(), names.end(), name) != names.end();
+    };
+    auto check_found = [&](const std::vector<IncludedFile>& found) {
+        for (const auto& name: names) {
+            if (std::none_of(found.begin(), found.end(), [&](const IncludedFile& file) { return file.name == name; }))
+                throw std::runtime_error("File " + name + " was not found in archive");
+        }
+    };
+
+    // Names are paths inside directory of extraction, Haf can't write files anywhere else
+    auto check_name = [](const std::string& name) {
+        std::filesystem::path path(name);
+        bool parent = std::any_of(path.begin(), path.end(), [](const auto& part) { return part == ".."; });
+        if (path.has_root_path() || parent)
+            throw std::runtime_error("Name of included file " + name + " leads out of directory of extraction");
+    };
+
+    std::unique_ptr<BufferedWriter> stdout_writer;
+    if (to_stdout) stdout_writer = std::make_unique<BufferedWriter>(STDOUT_FILENO, 0);
+    auto write_stdout = [&](const char* data, size_t size) { stdout_writer->Write(data, size); };
+
+    if (!reader.Seekable()) {
+        // Pipe is read once: every file is extracted right after its header, to the current directory
+        if (!to_stdout) std::cout << "Directory of extraction: " << std::filesystem::current_path().string() << "\n";
+        std::vector<IncludedFile> extracted;
+        std::unordered_map<uint64_t, std::string> extracted_blocks;
+        // Data of blocks which are not extracted to files (all of them if files go to stdout) is spooled to temporary
+        // file, so files linked to them later are served without reading Haf again. Streamed blocks are not linked
+        std::optional<FileDescriptor> spool;
+        uint64_t spool_end = 0;
+        std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>> spooled_blocks;
+        auto write_spool = [&](const char* data, size_t size) {
+            WriteAt(spool->Get(), data, size, spool_end);
+            spool_end += size;
+        };
+        std::vector<char> spool_buffer;
+        auto read_spool = [&](uint64_t begin, uint64_t size) {
+            spool_buffer.resize(std::min<uint64_t>(size, IoBufferSize()));
+            for (uint64_t done = 0; done < size;) {
+                size_t read_bytes = ReadAt(spool->Get(), spool_buffer.data(),
+                                           std::min<uint64_t>(size - done, spool_buffer.size()), begin + done);
+                if (read_bytes == 0) throw std::runtime_error("Unexpected end of spooled data");
+                write_stdout(spool_buffer.data(), read_bytes);
+                done += read_bytes;
             }
-            if (bits.size() - start_pos < word_ + extra_bits) continue;
-
-            uint16_t end_pos = start_pos + word_ + extra_bits;
-            uint32_t wrong_bit = 0;
-            for (uint8_t bit = 0; bit < extra_bits; bit++) {
-                auto shift = (uint16_t) pow(2, bit);
-                uint8_t extra_bit = '\0';
-                for (uint16_t pos = start_pos + shift - 1 - bit; pos < end_pos - bit; pos += 2 * shift) {
-                    for (auto i = 0; (pos + i < end_pos) && (i < shift); i++) {
-                        extra_bit ^= bits[pos + i];
-                    }
+        };
+        uint64_t offset = HafHeaderSize(revision);
+        for (uint64_t file_read = 0; file_read < files_number; file_read++) {
+            auto file = ReadFileHeader(reader, offset, word_, revision);
+            const bool wanted = !file.deleted && is_wanted(file.name);
+            const bool spooled = !file.linked && !file.streamed && (to_stdout || !wanted);
+            const uint64_t spool_begin = spool_end;
+            if (spooled && !spool) spool.emplace(std::filesystem::temp_directory_path().string(), O_RDWR | O_TMPFILE);
+            if (!wanted) {
+                // Frames of streamed or compressed file are walked through to find its end
+                if (spooled) {
+                    offset += DecodeFile(reader, file, word_, revision, layout, write_spool);
+                    spooled_blocks[file.offset] = {spool_begin, spool_end - spool_begin};
+                } else if (file.streamed || file.compressed) {
+                    offset += DecodeFile(reader, file, word_, revision, layout, nullptr);
+                } else {
+                    offset += file.coded_size;
                 }
-                if (extra_bit) {
-                    wrong_bit += shift;
+                continue;
+            }
+            if (!to_stdout) check_name(file.name);
+            files.emplace_back(file.name + filename_end);
+            if (file.linked) {
+                // Block with data was read before, so data is taken from spool or from the file extracted from it
+                auto spooled_target = spooled_blocks.find(file.link);
+                auto target = extracted_blocks.find(file.link);
+                if (spooled_target == spooled_blocks.end() && target == extracted_blocks.end())
+                    throw std::runtime_error("Link of file " + file.name + " is damaged");
+                if (spooled_target != spooled_blocks.end() && spooled_target->second.second != file.size)
+                    throw std::runtime_error("Link of file " + file.name + " is damaged");
+                if (to_stdout) {
+                    read_spool(spooled_target->second.first, spooled_target->second.second);
+                } else {
+                    auto output_directory = std::filesystem::path(files.back()).parent_path();
+                    if (!output_directory.empty()) std::filesystem::create_directories(output_directory);
+                    if (spooled_target != spooled_blocks.end()) {
+                        FileDescriptor output(files.back(), O_WRONLY | O_CREAT | O_TRUNC);
+                        CopyRange(spool->Get(), spooled_target->second.first, output.Get(), 0,
+                                  spooled_target->second.second);
+                    } else {
+                        std::filesystem::copy_file(target->second, files.back(),
+                                                   std::filesystem::copy_options::overwrite_existing);
+                    }
                 }
-                bits.erase(bits.begin() + start_pos + shift - 1 - bit);
+                offset += file.coded_size;
+                extracted.push_back(std::move(file));
+                continue;
             }
-            end_pos -= extra_bits;
-            if (wrong_bit) {
-                bits[start_pos + wrong_bit - CountAddedBits(wrong_bit)] =
-                    !bits[start_pos + wrong_bit - CountAddedBits(wrong_bit)];
+            if (spooled) {
+                offset += DecodeFile(reader, file, word_, revision, layout, [&](const char* data, size_t size) {
+                    write_spool(data, size);
+                    write_stdout(data, size);
+                });
+                spooled_blocks[file.offset] = {spool_begin, spool_end - spool_begin};
+            } else if (to_stdout) {
+                offset += DecodeFile(reader, file, word_, revision, layout, write_stdout);
+            } else {
+                offset += ExtractFile(reader, file, word_, revision, layout, files.back());
+                extracted_blocks[file.offset] = files.back();
             }
+            extracted.push_back(std::move(file));
+        }
+        if (to_stdout) stdout_writer->Flush();
+        check_found(extracted);
+        return files;
+    }
 
-            while (end_pos >= CHAR_BIT) {
-                end_pos -= CHAR_BIT;
-                char word = '\0';
-                for (auto i = 0; i < CHAR_BIT; i++) {
-                    if (bits[0]) word++;
-                    bits.erase(bits.begin());
-                    if (i != CHAR_BIT - 1) word <<= 1;
-                }
-                if (reading_header) data.emplace_back(word);
-                else output_stream << word;
-                written_bytes++;
-                if (written_bytes == need_bytes) break;
-            }
-            start_pos = end_pos;
-            if (data.size() == INCLUDED_FILE_NAME_SIZE) {
-                need_bytes += data[0] + INCLUDED_FILE_SIZE;
-            } else if (reading_header && !data.empty() &&
-                       data.size() == INCLUDED_FILE_NAME_SIZE + data[0] + INCLUDED_FILE_SIZE) {
-                need_bytes += *reinterpret_cast<uint32_t*>(&data[INCLUDED_FILE_NAME_SIZE + data[0]]);
-                reading_header = false;
-                std::string filename(data.begin() + INCLUDED_FILE_NAME_SIZE,
-                                     data.begin() + INCLUDED_FILE_NAME_SIZE + data[0]);
-                filename += filename_end;
-                files.emplace_back(filename);
-                if (ha_file.find_last_of("/\\") != std::string::npos)
-                    filename = ha_file.substr(0, ha_file.find_last_of("/\\") + 1) += filename;
-                output_stream = std::ofstream(filename, std::ios::binary);
-            } else if (written_bytes == need_bytes) break;
-        }
-        output_stream.close();
+    // Offsets of all files are found first, then files are decoded independently, other files are not read at all
+    auto table = ReadFilesTable(reader, haf_size, files_number, word_, revision);
+    std::erase_if(table, [](const IncludedFile& file) { return file.deleted; });
+    check_found(table);
+    std::erase_if(table, [&](const IncludedFile& file) { return !is_wanted(file.name); });
+    std::string directory;
+    if (ha_file.find_last_of("/\\") != std::string::npos)
+        directory = ha_file.substr(0, ha_file.find_last_of("/\\") + 1);
+    if (!to_stdout)
+        std::cout << "Directory of extraction: "
+                  << (directory.empty() ? std::filesystem::current_path().string() : directory) << "\n";
+    for (const auto& file: table) {
+        if (!to_stdout) check_name(file.name);
+        files.emplace_back(file.name + filename_end);
     }
 
+    if (to_stdout) {
+        for (const auto& file: table) {
+            DecodeFile(reader, file, word_, revision, layout, write_stdout);
+        }
+        stdout_writer->Flush();
+        return files;
+    }
+    if (threads == 1) {
+        for (size_t i = 0; i < table.size(); i++) {
+            ExtractFile(reader, table[i], word_, revision, layout, directory + files[i]);
+        }
+        return files;
+    }
+    // Files of the same name (after concatenation or appending) would be written to one path at once, so only
+    // the last of them is extracted, as it is left by serial extraction
+    std::unordered_map<std::string, size_t> last_with_name;
+    for (size_t i = 0; i < table.size(); i++) {
+        last_with_name[files[i]] = i;
+    }
+    ThreadPool pool(threads);
+    std::vector<std::future<void>> extracted;
+    for (size_t i = 0; i < table.size(); i++) {
+        if (last_with_name[files[i]] != i) continue;
+        extracted.push_back(pool.Submit([&, i]() {
+            ExtractFile(reader, table[i], word_, revision, layout, directory + files[i]);
+        }));
+    }
+    for (auto& file: extracted) {
+        file.get();
+    }
     return files;
 }
 
 void AppendFilesToHaf(const std::string& output_filename, std::vector<std::string>& args) {
-    std::vector<std::string> files;
-    auto input_stream = std::ifstream(output_filename, std::ios::binary);
-    if (!input_stream.is_open()) {
-        throw std::runtime_error("Failed to open " + output_filename);
-    }
-    uint32_t haf_first_size;
-    uint32_t files_number;
-    uint8_t word_;
+    auto reader = std::make_unique<FileReader>(output_filename);
+    uint64_t haf_first_size;
+    uint64_t files_number;
+    uint16_t word_;
+    HafRevision revision;
+    BlockLayout layout;
     std::cout << "Appending files to Haf \"" << output_filename << "\"\n";
-    std::tie(haf_first_size, files_number, word_) = ReadHeader(input_stream);
+    std::tie(haf_first_size, files_number, word_, revision, layout) = ReadHeader(*reader);
     std::cout << "Archive size before: " << haf_first_size << "B\n";
     std::cout << "Files number before: " << files_number << "\n";
-    std::cout << "Coded with word: " << (uint16_t) word_ << "bit\n";
+    std::cout << "Coded with word: " << WordName(word_) << "\n";
 
-    uint32_t haf_after_size = haf_first_size;
+    // New files replace old directory, new directory is written after them
+    auto table = ReadFilesTable(*reader, haf_first_size, files_number, word_, revision);
+    reader.reset();
+    // Old Haf gets directory, but its files keep 32-bit sizes
+    if (revision == HafRevision::Legacy) revision = HafRevision::Directory;
+    uint64_t data_begin = HafHeaderSize(revision);
+    uint64_t append_offset = table.empty() ? data_begin : table.back().offset + table.back().coded_size;
+    auto files = ListInputFiles(args, "");
+    auto appended = MakeFilesTable(files, word_, append_offset, revision, layout);
 
-    for (const auto& filename: args) {
-        if (!std::filesystem::is_regular_file(filename))
-            throw std::runtime_error("File [" + filename + "] does not exist");
-
-        uint8_t filename_size = filename.size();
-        if (filename.find_last_of("/\\") != std::string::npos) filename_size -= filename.find_last_of("/\\") + 1;
-        uint32_t file_size = INCLUDED_FILE_NAME_SIZE + filename_size +
-                             INCLUDED_FILE_SIZE + std::filesystem::file_size(filename);
-        auto words_count = (uint32_t) std::ceil((double) (CHAR_BIT * file_size) / word_);
-        haf_after_size += std::ceil((double) (words_count * (word_ + CountAddedBits(word_))) / CHAR_BIT);
-    }
-    files_number += args.size();
-    input_stream.close();
-    auto output_stream = std::ofstream(output_filename, std::ios::in | std::ios::binary);
-    std::vector<char> header;
-    header.push_back('H');
-    header.push_back('A');
-    header.insert(header.end(),
-                  (char*) &haf_after_size,
-                  (char*) &haf_after_size + sizeof(haf_after_size));
-    header.insert(header.end(),
-                  (char*) &files_number,
-                  (char*) &files_number + sizeof(files_number));
-    header.insert(header.end(),
-                  (char*) &word_,
-                  (char*) &word_ + sizeof(word_));
-    WriteHeader(header, output_stream);
-    output_stream.seekp(haf_first_size, std::ios_base::beg);
-    WriteFiles(args, output_stream, word_, "");
+    // Sizes of streamed files are known after writing, so header is written the last
+    FileDescriptor output(output_filename, O_WRONLY);
+    BufferedWriter writer(output.Get(), append_offset);
+    WriteFiles(files, appended, writer, word_, revision, layout);
+    table.insert(table.end(), appended.begin(), appended.end());
+    auto directory = MakeDirectory(table);
+    uint64_t haf_after_size = writer.Offset() + directory.size();
+    files_number += files.size();
+    writer.Write(directory.data(), directory.size());
+    writer.Seek(0);
+    WriteHeader(MakeHeader(haf_after_size, files_number, word_, revision, layout), writer);
+    writer.Flush();
+    if (std::filesystem::file_size(output_filename) > haf_after_size)
+        std::filesystem::resize_file(output_filename, haf_after_size);
 
     std::cout << "Final archive size: " << haf_after_size << "B\n";
     std::cout << "Files number after: " << files_number << '\n';
 }
 
-void DeleteFilesFromHaf(const std::string& output_filename, std::vector<std::string>& args) {
-    auto input_stream = std::ifstream(output_filename, std::ios::binary);
-    if (!input_stream.is_open()) {
-        throw std::runtime_error("Failed to open " + output_filename);
+void MarkFileDeleted(const FileReader& reader, int output_fd, const IncludedFile& file, uint16_t word_) {
+    // Header is coded again as whole groups of codewords (word_ bytes of data are code length bytes),
+    // so codewords of data after them are not changed
+    uint64_t header_size = IncludedFileHeaderSize(file.name, HafRevision::Wide);
+    const uint64_t group_bytes = GroupDataBytes(word_);
+    uint64_t data_bytes = std::min<uint64_t>(FileBlockBytes(file, HafRevision::Wide),
+                                             (header_size + group_bytes - 1) / group_bytes * group_bytes);
+    uint64_t coded_size = EncodedSize(word_, data_bytes);
+    std::vector<char> buffer;
+    auto coded = reader.Read(file.offset, coded_size, buffer);
+    if (coded.size() != coded_size)
+        throw std::runtime_error("Unexpected end of Haf");
+    std::vector<char> data;
+    HammingDecoder(word_, data_bytes).Update(coded.data(), coded.size(), data);
+
+    uint64_t marked_size = FlaggedFileSize(file) | DELETED_FILE_FLAG;
+    std::memcpy(&data[header_size - WIDE_INCLUDED_FILE_SIZE], &marked_size, sizeof(marked_size));
+    std::vector<char> marked;
+    HammingEncoder encoder(word_);
+    encoder.Update(data.data(), data.size(), marked);
+    encoder.Finish(marked);
+    WriteAt(output_fd, marked.data(), marked.size(), file.offset);
+}
+
+// Writes Haf with kept files to .tmp and replaces output_filename with it, runs of blocks following each other
+// are copied at once. Linked file whose data is not kept gets the data, the next files linked to it are linked
+// to this file
+void RewriteHaf(const std::string& output_filename, const FileReader& reader, std::vector<IncludedFile> kept_files,
+                uint16_t word_, HafRevision revision, BlockLayout layout) {
+    const std::vector<IncludedFile> source_files = kept_files;
+    std::unordered_map<uint64_t, uint64_t> moved_blocks;
+    uint64_t data_end = HafHeaderSize(revision);
+    for (auto& file: kept_files) {
+        if (!file.linked) {
+            moved_blocks[file.offset] = data_end;
+        } else if (moved_blocks.contains(file.link)) {
+            file.link = moved_blocks[file.link];
+        } else {
+            moved_blocks[file.link] = data_end;
+            file.linked = false;
+            file.coded_size = EncodedSize(word_, FileBlockBytes(file, revision));
+        }
+        file.offset = data_end;
+        data_end += file.coded_size;
+    }
+    auto directory = MakeDirectory(kept_files);
+    uint64_t haf_after_size = data_end + directory.size();
+
+    ReplacingFile output(output_filename);
+    BufferedWriter writer(output.Get(), 0);
+    WriteHeader(MakeHeader(haf_after_size, kept_files.size(), word_, revision, layout), writer);
+    writer.Seek(data_end);
+    writer.Write(directory.data(), directory.size());
+    writer.Flush();
+    ThreadPool coder(1);
+    for (size_t begin = 0, end; begin < kept_files.size(); begin = end) {
+        end = begin + 1;
+        if (kept_files[begin].linked) {
+            auto block = MakeLinkBlock(kept_files[begin], word_);
+            WriteAt(output.Get(), block.data(), block.size(), kept_files[begin].offset);
+            continue;
+        }
+        if (source_files[begin].linked) {
+            BufferedWriter file_writer(output.Get(), kept_files[begin].offset);
+            TranscodeFile(reader, source_files[begin], word_, revision, layout, word_, layout, file_writer, coder);
+            file_writer.Flush();
+            continue;
+        }
+        uint64_t run_size = kept_files[begin].coded_size;
+        for (; end < kept_files.size() && !source_files[end].linked &&
+               source_files[end].offset == source_files[begin].offset + run_size; end++) {
+            run_size += kept_files[end].coded_size;
+        }
+        CopyRange(reader.Descriptor(), source_files[begin].offset, output.Get(), kept_files[begin].offset, run_size);
     }
-    uint32_t haf_first_size;
-    uint32_t files_number;
-    uint8_t word_;
+    output.Replace();
+    std::cout << "Final archive size: " << haf_after_size << "B\n";
+    std::cout << "Files number after: " << kept_files.size() << "\n";
+}
+
+void DeleteFilesFromHaf(const std::string& output_filename, std::vector<std::string>& args, bool tombstone) {
+    FileReader reader(output_filename);
+    uint64_t haf_first_size;
+    uint64_t files_number;
+    uint16_t word_;
+    HafRevision revision;
+    BlockLayout layout;
     std::cout << "Deleting files from Haf \"" << output_filename << "\"\n";
-    std::tie(haf_first_size, files_number, word_) = ReadHeader(input_stream);
+    std::tie(haf_first_size, files_number, word_, revision, layout) = ReadHeader(reader);
     std::cout << "Archive size before: " << haf_first_size << "B\n";
     std::cout << "Files number before: " << files_number << "\n";
-    std::cout << "Coded with word: " << (uint16_t) word_ << "bit\n";
-
-    uint32_t n_files_deleted = args.size();
-
-    auto output_stream = std::ofstream(output_filename + ".tmp", std::ios::binary);
-    WriteHeader(std::vector<char>(HEADER_SIZE_WITHOUT_CODING, '\0'), output_stream);
-    const auto extra_bits = CountAddedBits(word_);
-    for (uint32_t file_read = 0; file_read < files_number; file_read++) {
-        uint32_t start_pos = 0;
-        char byte;
-        std::vector<bool> bits;
-        std::vector<char> data;
-        uint32_t need_bytes = INCLUDED_FILE_NAME_SIZE;
-        uint32_t written_bytes = 0;
-        while (input_stream.get(byte)) {
-            for (auto j = 0; j < CHAR_BIT; j++) {
-                bits.emplace_back(byte & 0b10000000);
-                byte <<= 1;
-            }
-            if (bits.size() - start_pos < word_ + extra_bits) continue;
-
-            uint32_t end_pos = start_pos + word_ + extra_bits;
-            uint32_t wrong_bit = 0;
-            for (uint8_t bit = 0; bit < extra_bits; bit++) {
-                auto shift = (uint16_t) pow(2, bit);
-                uint8_t extra_bit = '\0';
-                for (uint32_t pos = start_pos + shift - 1 - bit; pos < end_pos - bit; pos += 2 * shift) {
-                    for (auto i = 0; (pos + i < end_pos) && (i < shift); i++) {
-                        extra_bit ^= bits[pos + i];
-                    }
-                }
-                if (extra_bit) {
-                    wrong_bit += shift;
-                }
-                bits.erase(bits.begin() + start_pos + shift - 1 - bit);
-            }
-            end_pos -= extra_bits;
-            if (wrong_bit) {
-                bits[start_pos + wrong_bit - CountAddedBits(wrong_bit)] =
-                    !bits[start_pos + wrong_bit - CountAddedBits(wrong_bit)];
-            }
+    std::cout << "Coded with word: " << WordName(word_) << "\n";
 
-            while (end_pos >= CHAR_BIT) {
-                end_pos -= CHAR_BIT;
-                char word = '\0';
-                for (auto i = 0; i < CHAR_BIT; i++) {
-                    if (bits[0]) word++;
-                    bits.erase(bits.begin());
-                    if (i != CHAR_BIT - 1) word <<= 1;
-                }
-                data.emplace_back(word);
-                written_bytes++;
-                if (written_bytes == need_bytes) break;
-            }
-            start_pos = end_pos;
-            if (data.size() == INCLUDED_FILE_NAME_SIZE) {
-                need_bytes += data[0] + INCLUDED_FILE_SIZE;
-            } else if (written_bytes == need_bytes) break;
-        }
-
-        bool file_found = false;
-        uint32_t bytes_read = std::ceil(
-            std::ceil((double) data.size() * CHAR_BIT / word_) * (word_ + extra_bits) / CHAR_BIT);
-        uint32_t data_bytes = *reinterpret_cast<uint32_t*>(&data[INCLUDED_FILE_NAME_SIZE + data[0]]);
-        auto total_file_bytes = (uint32_t) std::ceil(
-            std::ceil((double) (data.size() + data_bytes) * CHAR_BIT / word_) * (word_ + extra_bits)
-            / CHAR_BIT);
-        std::string filename(data.begin() + INCLUDED_FILE_NAME_SIZE,
-                             data.begin() + INCLUDED_FILE_NAME_SIZE + data[0]);
-        for (uint32_t i = 0; i < args.size(); i++) {
-            if (filename == args[i]) {
-                file_found = true;
-                args.erase(args.begin() + i);
-                haf_first_size -= total_file_bytes;
-                uint32_t skipped_bytes = (uint32_t) std::ceil(
-                    std::ceil((double) (data.size() + data_bytes) * CHAR_BIT / word_) * (word_ + extra_bits)
-                    / CHAR_BIT) - bytes_read;
-                input_stream.seekg(skipped_bytes, std::ios_base::cur);
-                break;
+    auto table = ReadFilesTable(reader, haf_first_size, files_number, word_, revision);
+    // Every name deletes one file, files marked deleted before are not found
+    std::vector<bool> deleting(table.size());
+    for (const auto& name: args) {
+        size_t i = 0;
+        while (i < table.size() && (table[i].deleted || deleting[i] || table[i].name != name)) i++;
+        if (i == table.size()) throw std::runtime_error("File " + name + " was not found in archive");
+        deleting[i] = true;
+    }
+
+    if (tombstone && revision != HafRevision::Wide)
+        std::cout << "Files of 32-bit Haf can't be marked deleted, Haf is written again\n";
+    if (tombstone && revision == HafRevision::Wide) {
+        FileDescriptor output(output_filename, O_WRONLY);
+        for (size_t i = 0; i < table.size(); i++) {
+            if (!deleting[i]) continue;
+            MarkFileDeleted(reader, output.Get(), table[i], word_);
+            table[i].deleted = true;
+        }
+        // Directory keeps its size and place, only flags and checksum are changed
+        uint64_t data_end = table.empty() ? WIDE_HEADER_SIZE : table.back().offset + table.back().coded_size;
+        auto directory = MakeDirectory(table);
+        WriteAt(output.Get(), directory.data(), directory.size(), data_end);
+        std::cout << "Files marked deleted: " << args.size() << "\n";
+        return;
+    }
+
+    std::vector<IncludedFile> kept_files;
+    for (size_t i = 0; i < table.size(); i++) {
+        if (!deleting[i] && !table[i].deleted) kept_files.push_back(table[i]);
+    }
+    if (revision == HafRevision::Legacy) revision = HafRevision::Directory;
+    RewriteHaf(output_filename, reader, kept_files, word_, revision, layout);
+}
+
+void CompactHaf(const std::string& ha_file) {
+    FileReader reader(ha_file);
+    uint64_t haf_size;
+    uint64_t files_number;
+    uint16_t word_;
+    HafRevision revision;
+    BlockLayout layout;
+    std::cout << "Compacting Haf \"" << ha_file << "\"\n";
+    std::tie(haf_size, files_number, word_, revision, layout) = ReadHeader(reader);
+    std::cout << "Archive size before: " << haf_size << "B\n";
+    std::cout << "Files number before: " << files_number << "\n";
+
+    auto table = ReadFilesTable(reader, haf_size, files_number, word_, revision);
+    std::erase_if(table, [](const IncludedFile& file) { return file.deleted; });
+    if (revision == HafRevision::Legacy) revision = HafRevision::Directory;
+    RewriteHaf(ha_file, reader, table, word_, revision, layout);
+}
+
+// Counts errors of coded block of data_bytes from offset without decoding, block is read by parts of whole slices
+CodewordErrors CheckBlock(const FileReader& reader, uint64_t offset, uint64_t data_bytes, uint16_t word_,
+                          BlockLayout layout, uint64_t first_group, int repair_fd) {
+    const auto& code = GetHammingCode(word_);
+    const uint64_t part_groups = std::max<uint64_t>(1, IoBufferSize() / (SLICE_GROUPS * code.length)) * SLICE_GROUPS;
+    const uint64_t slice_begin = SliceBegin(word_, layout);
+    CodewordErrors errors;
+    std::vector<char> buffer;
+    std::vector<uint64_t> wrong_bits;
+    std::vector<char> repaired;
+    for (uint64_t checked = 0; checked < data_bytes;) {
+        uint64_t part_bytes = std::min<uint64_t>(data_bytes - checked, part_groups * code.word);
+        uint64_t coded_size = EncodedSize(word_, part_bytes);
+        auto coded = reader.Read(offset, coded_size, buffer);
+        if (coded.size() != coded_size)
+            throw std::runtime_error("Unexpected end of Haf");
+        CheckBlockCodewords(code, reinterpret_cast<const uint8_t*>(coded.data()), part_bytes,
+                            first_group + checked / code.word, slice_begin, errors,
+                            repair_fd >= 0 ? &wrong_bits : nullptr);
+        // Bits of one byte (they may be of different codewords) and adjacent bytes are written by one pwrite
+        std::sort(wrong_bits.begin(), wrong_bits.end());
+        for (size_t i = 0; i < wrong_bits.size();) {
+            uint64_t first_byte = wrong_bits[i] / CHAR_BIT;
+            uint64_t end_byte = first_byte;
+            repaired.clear();
+            for (; i < wrong_bits.size() && wrong_bits[i] / CHAR_BIT <= end_byte; i++) {
+                if (wrong_bits[i] / CHAR_BIT == end_byte) repaired.push_back(coded[end_byte++]);
+                repaired.back() ^= (char) (0x80 >> (wrong_bits[i] % CHAR_BIT));
             }
+            WriteAt(repair_fd, repaired.data(), repaired.size(), offset + first_byte);
+        }
+        wrong_bits.clear();
+        offset += coded_size;
+        checked += part_bytes;
+    }
+    return errors;
+}
+
+CodewordErrors VerifyHaf(const std::string& ha_file, unsigned threads, bool repair) {
+    if (threads == 0) {
+        throw std::runtime_error("Number of threads must be positive");
+    }
+    auto start = std::chrono::steady_clock::now();
+    FileReader reader(ha_file);
+    uint64_t haf_size;
+    uint64_t files_number;
+    uint16_t word_;
+    HafRevision revision;
+    BlockLayout layout;
+    std::cout << (repair ? "Repairing" : "Verifying") << " Haf \"" << ha_file << "\"\n";
+    if (repair && !reader.Seekable())
+        throw std::runtime_error(ha_file + " is a pipe, it can't be repaired in place");
+    std::unique_ptr<FileDescriptor> output;
+    if (repair) output = std::make_unique<FileDescriptor>(ha_file, O_WRONLY);
+    const int repair_fd = repair ? output->Get() : -1;
+    // Header is read as if it were not damaged, then it is checked (and repaired) before files are searched by it
+    HafRevision header_revision = std::get<3>(ReadHeader(reader));
+    CodewordErrors header_errors = CheckBlock(reader, 0, header_revision == HafRevision::Wide
+                                                         ? WIDE_HEADER_SIZE_WITHOUT_CODING
+                                                         : HEADER_SIZE_WITHOUT_CODING,
+                                              DEFAULT_LENGTH, BlockLayout::Packed, 0, repair_fd);
+    std::tie(haf_size, files_number, word_, revision, layout) = ReadHeader(reader);
+    std::cout << "Archive size: " << haf_size << "B\n";
+    std::cout << "Files number: " << files_number << "\n";
+    std::cout << "Coded with word: " << WordName(word_) << "\n";
+    if (layout == BlockLayout::Interleaved) std::cout << "Codewords are interleaved by slices of 64\n";
+
+    // Parts of blocks are checked by workers, Haf from pipe is checked in one pass by this thread
+    std::vector<IncludedFile> table;
+    std::vector<CodewordErrors> errors;
+    std::unique_ptr<ThreadPool> pool;
+    if (reader.Seekable()) pool = std::make_unique<ThreadPool>(threads);
+    std::deque<std::pair<size_t, std::future<CodewordErrors>>> pending;
+    auto add_errors = [&](size_t file, const CodewordErrors& found) {
+        errors[file].corrected += found.corrected;
+        errors[file].uncorrectable += found.uncorrectable;
+    };
+    auto collect = [&]() {
+        add_errors(pending.front().first, pending.front().second.get());
+        pending.pop_front();
+    };
+    auto check = [&](size_t file, uint64_t offset, uint64_t data_bytes, uint16_t word, uint64_t first_group) {
+        if (!pool) {
+            add_errors(file, CheckBlock(reader, offset, data_bytes, word, layout, first_group, repair_fd));
+            return;
         }
+        pending.emplace_back(file, pool->Submit([&reader, offset, data_bytes, word, layout, first_group, repair_fd]() {
+            return CheckBlock(reader, offset, data_bytes, word, layout, first_group, repair_fd);
+        }));
+        if (pending.size() >= 2 * threads) collect();
+    };
+
+    // Blocks are split into parts of whole slices (word bytes of data are code length bytes, slice is 8 groups),
+    // streamed and compressed files are split by frames. Size of streamed file read from pipe is known after its frames
+    auto check_block = [&](size_t i, uint64_t offset, uint64_t data_bytes, uint16_t word) {
+        const uint64_t group_bytes = GroupDataBytes(word);
+        const uint64_t group_size = CodewordLength(word);
+        const uint64_t part_bytes = std::max<uint64_t>(1, IoBufferSize() / (SLICE_GROUPS * group_size)) *
+                                    SLICE_GROUPS * group_bytes;
+        for (uint64_t begin = 0; begin < data_bytes; begin += part_bytes) {
+            check(i, offset + begin / group_bytes * group_size, std::min(part_bytes, data_bytes - begin), word,
+                  begin / group_bytes);
+        }
+    };
+    auto check_file = [&](size_t i) {
+        IncludedFile& file = table[i];
+        // Data of file with its own word is coded with it after block of header
+        uint64_t header_block_bytes = FileBlockBytes(file, revision);
+        uint64_t header_coded_size = EncodedSize(word_, header_block_bytes);
+        const uint16_t data_word = file.word ? file.word : word_;
+        if (file.linked) {
+            // Block of linked file is packed and short, so it is checked at once
+            add_errors(i, CheckBlock(reader, file.offset, header_block_bytes, word_, BlockLayout::Packed, 0,
+                                     repair_fd));
+            return;
+        }
+        if (!file.streamed && !file.compressed) {
+            check_block(i, file.offset, header_block_bytes, word_);
+            if (file.word) check_block(i, file.offset + header_coded_size, file.size, data_word);
+            return;
+        }
+        check(i, file.offset, header_block_bytes, word_, 0);
+        auto [frames_size, file_size] = ReadFrames(reader, file.offset + header_coded_size, data_word,
+                                                   [&](uint64_t offset, uint64_t data_bytes, bool) {
+                                                       check(i, offset, data_bytes, data_word, 0);
+                                                   });
+        file.coded_size = header_coded_size + frames_size;
+        file.size = file_size;
+    };
+
+    if (reader.Seekable()) {
+        table = ReadFilesTable(reader, haf_size, files_number, word_, revision);
+        errors.resize(table.size());
+        for (size_t i = 0; i < table.size(); i++) {
+            check_file(i);
+        }
+    } else {
+        uint64_t offset = HafHeaderSize(revision);
+        for (uint64_t file_read = 0; file_read < files_number; file_read++) {
+            table.push_back(ReadFileHeader(reader, offset, word_, revision));
+            errors.emplace_back();
+            check_file(table.size() - 1);
+            offset += table.back().coded_size;
+        }
+    }
+    while (!pending.empty()) {
+        collect();
+    }
 
-        if (!file_found) {
-            input_stream.seekg(-(int64_t) bytes_read, std::ios_base::cur);
-            for (auto i = 0; i < total_file_bytes; i++) {
-                char element;
-                input_stream.get(element);
-                output_stream << element;
+    // Directory follows the last block, its entries and trailer are checked as blocks of 11-bit words. If size of
+    // Haf differs from its blocks with directory, the directory can't be found and Haf is damaged
+    uint64_t data_end = table.empty() ? HafHeaderSize(revision) : table.back().offset + table.back().coded_size;
+    auto directory = revision != HafRevision::Legacy ? MakeDirectory(table) : std::vector<char>();
+    bool size_matches = data_end + directory.size() == haf_size && (!reader.Seekable() || reader.Size() == haf_size);
+    CodewordErrors directory_errors;
+    if (!directory.empty() && size_matches) {
+        uint64_t entries_bytes = MakeDirectoryEntries(table).size();
+        uint64_t trailer_offset = data_end + EncodedSize(DEFAULT_LENGTH, entries_bytes);
+        for (const auto& found: {CheckBlock(reader, data_end, entries_bytes, DEFAULT_LENGTH, BlockLayout::Packed, 0,
+                                            repair_fd),
+                                 CheckBlock(reader, trailer_offset, HEADER_SIZE_WITHOUT_CODING, DEFAULT_LENGTH,
+                                            BlockLayout::Packed, 0, repair_fd)}) {
+            directory_errors.corrected += found.corrected;
+            directory_errors.uncorrectable += found.uncorrectable;
+        }
+    }
+    // Haf from pipe has no size, it must end after directory
+    std::vector<char> end_buffer;
+    if (size_matches && !reader.Seekable()) size_matches = reader.Read(haf_size, 1, end_buffer).empty();
+
+    // Directory is made again from the table and only its differing bytes are written, so it is repaired
+    // even if its checksum was broken and files were searched by their headers
+    uint64_t directory_bytes = 0;
+    if (repair && !directory.empty() && size_matches) {
+        std::vector<char> buffer;
+        auto current = reader.Read(data_end, directory.size(), buffer);
+        for (size_t i = 0; i < directory.size();) {
+            if (directory[i] == current[i]) {
+                i++;
+                continue;
             }
+            size_t end = i;
+            while (end < directory.size() && directory[end] != current[end]) end++;
+            WriteAt(repair_fd, directory.data() + i, end - i, data_end + i);
+            directory_bytes += end - i;
+            i = end;
         }
     }
 
-    if (!args.empty()) throw std::runtime_error("File " + args[0] + " was not found in archive");
-    else {
-        files_number -= n_files_deleted;
-        input_stream.close();
-        output_stream.seekp(0, std::ios_base::beg);
-        std::vector<char> header;
-        header.push_back('H');
-        header.push_back('A');
-        header.insert(header.end(),
-                      (char*) &haf_first_size,
-                      (char*) &haf_first_size + sizeof(haf_first_size));
-        header.insert(header.end(),
-                      (char*) &files_number,
-                      (char*) &files_number + sizeof(files_number));
-        header.insert(header.end(),
-                      (char*) &word_,
-                      (char*) &word_ + sizeof(word_));
-        WriteHeader(header, output_stream);
-        output_stream.close();
-        remove(output_filename.c_str());
-        rename((output_filename + ".tmp").c_str(), output_filename.c_str());
+    CodewordErrors total = header_errors;
+    total.corrected += directory_errors.corrected;
+    total.uncorrectable += directory_errors.uncorrectable;
+    uint64_t checked_bytes = 0;
+    const std::string corrected_name = repair ? "repaired" : "corrected";
+    std::cout << "Errors of Haf header (" << corrected_name << ", uncorrectable): " << header_errors.corrected << ", "
+              << header_errors.uncorrectable << "\n";
+    if (!directory.empty())
+        std::cout << "Errors of directory (" << corrected_name << ", uncorrectable): " << directory_errors.corrected
+                  << ", " << directory_errors.uncorrectable << "\n";
+    if (!size_matches) {
+        // Size is not coded by codewords of its own, so mismatch is counted as one uncorrectable codeword
+        std::cout << "Size of Haf " << haf_size << "B differs from its blocks with directory ("
+                  << data_end + directory.size() << "B)";
+        std::cout << (reader.Seekable() ? " or from size of file (" + std::to_string(reader.Size()) + "B)"
+                                        : " or Haf from pipe does not end after directory") << "\n";
+        total.uncorrectable++;
     }
+    std::cout << "Errors of files (" << corrected_name << " codewords, suspected uncorrectable codewords):\n";
+    for (size_t i = 0; i < table.size(); i++) {
+        std::cout << '\"' << table[i].name << "\" " << table[i].size << "B" << (table[i].deleted ? " (deleted)" : "")
+                  << ": " << errors[i].corrected << ", " << errors[i].uncorrectable << "\n";
+        total.corrected += errors[i].corrected;
+        total.uncorrectable += errors[i].uncorrectable;
+        checked_bytes += table[i].coded_size;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << (repair ? "Repaired codewords: " : "Corrected codewords: ") << total.corrected << "\n";
+    if (repair) std::cout << "Rewritten bytes of directory: " << directory_bytes << "\n";
+    std::cout << "Suspected uncorrectable codewords: " << total.uncorrectable << "\n";
+    std::cout << "Checked " << checked_bytes << "B in " << seconds << "s ("
+              << (seconds > 0 ? checked_bytes / seconds / 1e9 : 0) << " GB/s)\n";
+    return total;
 }
 
-void ConcatenateHaf(const std::string& output_filename, std::vector<std::string>& args) {
-    std::vector<std::string> filenames_result;
-    std::string directory;
-    if (output_filename.find_last_of("/\\") != std::string::npos)
-        directory = output_filename.substr(0, output_filename.find_last_of("/\\") + 1);
-    for (const auto& file: args) {
-        for (const auto& inner_file: ExtractHaf(file, ".tmp")) {
+/*
+ * Decoded parts of file are passed to coder, which is one thread taking tasks in order, so coding of one part
+ * runs while the next part is decoded. At most two parts are in flight, memory does not depend on size of file
+ */
+void TranscodeFile(const FileReader& reader, const IncludedFile& file, uint16_t word_, HafRevision revision,
+                   BlockLayout layout, uint16_t new_word, BlockLayout new_layout, BufferedWriter& writer,
+                   ThreadPool& coder) {
+    auto encoder = std::make_shared<HammingEncoder>(new_word, new_layout);
+    auto coded = std::make_shared<std::vector<char>>();
+    auto file_header = MakeFileHeader(file.name, file.size, HafRevision::Wide);
+    encoder->Update(file_header.data(), file_header.size(), *coded);
 
-            filenames_result.emplace_back(directory + inner_file.substr(0, inner_file.length() - 4));
+    std::deque<std::future<void>> pending;
+    DecodeFile(reader, file, word_, revision, layout, [&](const char* data, size_t size) {
+        auto part = std::make_shared<std::vector<char>>(data, data + size);
+        pending.push_back(coder.Submit([=, &writer]() {
+            encoder->Update(part->data(), part->size(), *coded);
+            writer.Write(coded->data(), coded->size());
+            coded->clear();
+        }));
+        if (pending.size() >= 2) {
+            pending.front().get();
+            pending.pop_front();
         }
+    });
+    for (auto& part: pending) {
+        part.get();
+    }
+    encoder->Finish(*coded);
+    writer.Write(coded->data(), coded->size());
+}
+
+/*
+ * Writes files of all parts to new Haf of 64-bit revision coded with word_ or, if it is 0, with the strongest word
+ * of parts and their files (the fewest data bits in codeword), so no file loses protection, and with layout or, if
+ * it is not set, with the common layout of parts (packed if they differ). Blocks of files of the same word length,
+ * layout and revision are copied without decoding, other files are coded again
+ */
+void MergeHaf(const std::string& output_filename, const std::vector<std::string>& args, uint16_t word_,
+              std::optional<BlockLayout> layout) {
+    struct Part {
+        std::unique_ptr<FileReader> reader;
+        uint16_t word;
+        HafRevision revision;
+        BlockLayout layout;
+        std::vector<IncludedFile> table;
+    };
+
+    std::vector<Part> parts;
+    for (const auto& filename: args) {
+        auto reader = std::make_unique<FileReader>(filename);
+        if (!reader->Seekable())
+            throw std::runtime_error(filename + " is a pipe, it can't be concatenated");
+        auto [haf_size, files_number, word_, revision, layout] = ReadHeader(*reader);
+        auto table = ReadFilesTable(*reader, haf_size, files_number, word_, revision);
+        std::erase_if(table, [](const IncludedFile& file) { return file.deleted; });
+        parts.push_back({std::move(reader), word_, revision, layout, std::move(table)});
     }
-    CreateHaf(output_filename, filenames_result, DEFAULT_LENGTH, ".tmp");
-    for (const auto& file: filenames_result) {
-        remove((file + ".tmp").c_str());
+
+    if (!layout) {
+        layout = BlockLayout::Packed;
+        if (!parts.empty() && std::all_of(parts.begin(), parts.end(), [&](const Part& part) {
+            return part.layout == parts.front().layout;
+        })) layout = parts.front().layout;
     }
+    if (word_ == 0) {
+        // Of words with as many data bits aligned profile is stronger, it has one more check bit
+        auto stronger = [&](uint16_t word, uint16_t than) {
+            if (than == 0) return true;
+            if (GroupDataBytes(word) != GroupDataBytes(than)) return GroupDataBytes(word) < GroupDataBytes(than);
+            return CodewordLength(word) > CodewordLength(than);
+        };
+        auto take = [&](uint16_t word) {
+            if (word != 0 && !(*layout == BlockLayout::Interleaved && (word & ALIGNED_PROFILE_FLAG)) &&
+                stronger(word, word_)) word_ = word;
+        };
+        for (const auto& part: parts) {
+            take(part.word);
+            for (const auto& file: part.table) {
+                take(file.word);
+            }
+        }
+        if (word_ == 0) word_ = DEFAULT_LENGTH;
+    }
+    for (const auto& part: parts) {
+        for (const auto& file: part.table) {
+            if (file.name.size() > MaxFileNameSize(*layout))
+                throw std::runtime_error("Name " + file.name + " is longer than " +
+                                         std::to_string(MaxFileNameSize(*layout)) + "B" +
+                                         (*layout == BlockLayout::Interleaved ? " of Haf with interleaved codewords"
+                                                                              : ""));
+        }
+    }
+    auto copied = [&](const Part& part) {
+        return part.word == word_ && part.layout == *layout && part.revision == HafRevision::Wide;
+    };
+
+    // Links are moved with blocks of their parts as in RewriteHaf
+    std::vector<IncludedFile> table;
+    uint64_t data_end = WIDE_HEADER_SIZE;
+    uint64_t copied_files = 0;
+    for (const auto& part: parts) {
+        std::unordered_map<uint64_t, uint64_t> moved_blocks;
+        for (const auto& file: part.table) {
+            IncludedFile result_file{file.name, file.size, data_end, 0};
+            if (!file.linked) {
+                moved_blocks[file.offset] = data_end;
+            } else if (moved_blocks.contains(file.link)) {
+                result_file.linked = true;
+                result_file.link = moved_blocks[file.link];
+            } else {
+                moved_blocks[file.link] = data_end;
+            }
+            result_file.coded_size = EncodedSize(word_, FileBlockBytes(result_file, HafRevision::Wide));
+            if (copied(part) && !file.linked) {
+                // Copied file keeps its frames and its own word, coded files are not compressed and have word of Haf
+                result_file.streamed = file.streamed;
+                result_file.compressed = file.compressed;
+                result_file.word = file.word;
+                result_file.coded_size = file.coded_size;
+                copied_files++;
+            }
+            data_end += result_file.coded_size;
+            table.push_back(std::move(result_file));
+        }
+    }
+    auto directory = MakeDirectory(table);
+    uint64_t total_haf_size = data_end + directory.size();
+    std::cout << "Files number: " << table.size() << "\n";
+    std::cout << "Files copied without decoding: " << copied_files << "\n";
+    std::cout << "Coded with word: " << WordName(word_) << "\n";
+    if (layout == BlockLayout::Interleaved) std::cout << "Codewords are interleaved by slices of 64\n";
+
+    // Haf can't be truncated while it is read as part, so it is replaced
+    ReplacingFile output(output_filename);
+    BufferedWriter writer(output.Get(), 0);
+    WriteHeader(MakeHeader(total_haf_size, table.size(), word_, HafRevision::Wide, *layout), writer);
+    ThreadPool coder(1);
+    auto result_file = table.begin();
+    for (const auto& part: parts) {
+        for (const auto& file: part.table) {
+            if (result_file->linked) {
+                auto block = MakeLinkBlock(*result_file, word_);
+                writer.Write(block.data(), block.size());
+            } else if (copied(part) && !file.linked) {
+                writer.Flush();
+                CopyRange(part.reader->Descriptor(), file.offset, output.Get(), result_file->offset, file.coded_size);
+                writer.Seek(result_file->offset + file.coded_size);
+            } else {
+                TranscodeFile(*part.reader, file, part.word, part.revision, part.layout, word_, *layout, writer,
+                              coder);
+            }
+            ++result_file;
+        }
+    }
+    writer.Write(directory.data(), directory.size());
+    writer.Flush();
+    parts.clear();
+    output.Replace();
+    std::cout << "Result size: " << total_haf_size << "B\n";
+}
+
+void ConcatenateHaf(const std::string& output_filename, std::vector<std::string>& args) {
+    std::cout << "Concatenating Haf to \"" << output_filename << "\"\n";
+    MergeHaf(output_filename, args, 0, std::nullopt);
+}
+
+void TranscodeHaf(const std::string& ha_file, uint16_t word_, BlockLayout layout) {
+    CheckWordLayout(word_, layout);
+    std::cout << "Transcoding Haf \"" << ha_file << "\" to " << WordName(word_) << " words"
+              << (layout == BlockLayout::Interleaved ? " interleaved by slices of 64" : "") << "\n";
+    MergeHaf(ha_file, {ha_file}, word_, layout);
 }
 
 /*
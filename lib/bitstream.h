@@ -1,32 +1,245 @@
 #pragma once
 
+#include "error_rate.h"
+#include "file_io.h"
+#include "hamming.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <functional>
+#include <optional>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #define HEADER_SIZE 15
 #define HEADER_SIZE_WITHOUT_CODING 11
+#define WIDE_HEADER_SIZE 30
+#define WIDE_HEADER_SIZE_WITHOUT_CODING 22
 #define INCLUDED_FILE_NAME_SIZE 1
+// Name longer than 255 bytes has 0 instead of its size followed by 2-byte size (only in 64-bit revision)
+#define LONG_FILE_NAME_SIZE 2
+#define MAX_FILE_NAME_SIZE UINT16_MAX
 #define INCLUDED_FILE_SIZE 4
+#define WIDE_INCLUDED_FILE_SIZE 8
 #define DEFAULT_LENGTH 11
+// Upper bit of 64-bit file size marks block of deleted file which is kept until Haf is compacted
+#define DELETED_FILE_FLAG (1ULL << 63)
+// Next bit marks file of unknown size coded by frames (described in CreateHaf)
+#define STREAMED_FILE_FLAG (1ULL << 62)
+// Next bit marks file whose data is stored in block of earlier file with the same data (described in CreateHaf)
+#define LINKED_FILE_FLAG (1ULL << 61)
+#define LINK_OFFSET_SIZE 8
+// Next bit marks file whose data is coded by frames of compressed chunks (described in CreateHaf)
+#define COMPRESSED_FILE_FLAG (1ULL << 60)
+// Next bit marks file whose data is coded with its own word given after file_size (described in CreateHaf)
+#define OWN_WORD_FILE_FLAG (1ULL << 59)
+#define FILE_WORD_SIZE 2
+#define FRAME_SIZE_SIZE 4
+// Upper bit of frame size marks frame of compressed chunk
+#define COMPRESSED_FRAME_FLAG (1U << 31)
+
+// Revisions of Haf by type code
+enum class HafRevision {
+    Legacy,     // "HA": 32-bit sizes
+    Directory,  // "HB": 32-bit sizes and directory
+    Wide        // "HC": 64-bit sizes and directory
+};
+
+// Coded size of Haf header
+uint64_t HafHeaderSize(HafRevision revision);
+
+// Size of header of included file without coding
+uint64_t IncludedFileHeaderSize(const std::string& filename, HafRevision revision);
+
+// Headers of interleaved blocks are decoded by their packed prefix (described in hamming.h), so their names are short
+uint64_t MaxFileNameSize(BlockLayout layout);
+
+// [file_name_size][file_name] of header or directory entry, long name is [0][long_file_name_size][file_name]
+void AppendFileName(std::vector<char>& data, const std::string& filename);
+
+// Size of name field by its beginning (LONG_FILE_NAME_SIZE more bytes are read if the first one is 0)
+// and size of name itself
+std::pair<uint64_t, uint64_t> FileNameSize(const char* data);
+
+// Included file of Haf, offset is the beginning of its coded block
+struct IncludedFile {
+    std::string name;
+    uint64_t size;
+    uint64_t offset;
+    uint64_t coded_size;
+    bool deleted = false;
+    bool streamed = false;
+    // Linked file has no data of its own, link is offset of block with its data
+    bool linked = false;
+    uint64_t link = 0;
+    // Compressed file has size of its data, but is coded by frames like streamed file
+    bool compressed = false;
+    // Word of data of file coded with its own word, 0 if data is coded with word of Haf
+    uint16_t word = 0;
+};
+
+// Data bytes of the first block of file: header and data of file, header and link of linked file, only header
+// of streamed or compressed file or of file with its own word (with the word)
+uint64_t FileBlockBytes(const IncludedFile& file, HafRevision revision);
+
+// Coded size of file which is not streamed or compressed with its block of data coded with its own word
+uint64_t FileCodedSize(const IncludedFile& file, uint16_t word_, HafRevision revision);
+
+// Size of file with flags of header (size of streamed file is not known when its header is written)
+uint64_t FlaggedFileSize(const IncludedFile& file);
+
+void WriteHeader(const std::vector<char>& data, BufferedWriter& writer);
+
+std::string IncludedFileName(const std::string& filename_with_path);
+
+// File to include: path to read it and name in Haf
+struct InputFile {
+    std::string path;
+    std::string name;
+};
+
+// Files are included by their names, directories with all their files: "dir/sub/file" (sorted by names)
+std::vector<InputFile> ListInputFiles(const std::vector<std::string>& args, const std::string& filename_end);
+
+// threads > 1 gets sizes of files in parallel
+std::vector<IncludedFile> MakeFilesTable(const std::vector<InputFile>& files, uint16_t word_, uint64_t offset,
+                                         HafRevision revision, BlockLayout layout, unsigned threads = 1);
+
+std::vector<char> MakeFileHeader(const std::string& filename, uint64_t file_size, HafRevision revision);
+
+// Header of file with its flags and its own word
+std::vector<char> MakeFileHeader(const IncludedFile& file, HafRevision revision);
+
+// Chooses words of data of files and word of their headers (returned) for target: damaged header loses file,
+// and damaged compressed frame loses its chunk, so they get stronger words. Data of file gets its own word if it
+// differs from word of headers, offsets of files are moved
+uint16_t ChooseFileWords(std::vector<IncludedFile>& table, const ErrorTarget& target, BlockLayout layout,
+                         bool compress = false);
+
+// Files with the same data as earlier file of table are linked to it, offsets of the next files are moved.
+// threads > 1 hashes files in parallel. Returns number of linked files
+uint64_t LinkDuplicateFiles(const std::vector<InputFile>& files, std::vector<IncludedFile>& table, uint16_t word_,
+                            unsigned threads = 1);
+
+// Coded block of linked file, it is packed in Haf of any layout
+std::vector<char> MakeLinkBlock(const IncludedFile& file, uint16_t word_);
 
-uint8_t CountAddedBits(uint8_t word);
+// Frame of chunk before coding: compressed frame if it is smaller, otherwise frame of chunk itself
+std::vector<char> MakeCompressedFrame(const char* chunk, size_t size);
 
-void WriteHeader(const std::vector<char>& data, std::ofstream& stream);
+// The last frame of file: [0][file_size]
+std::vector<char> MakeEndFrame(uint64_t file_size);
 
-void WriteFiles(const std::vector<std::string>& files, std::ofstream& stream, uint8_t word_,
-                const std::string& filename_end);
+// Frames of file are smaller than its block if they are smaller even when all chunks after the first are not
+// compressed. So compressed file is never larger than it is without compression
+bool FramesAreSmaller(const IncludedFile& file, uint64_t first_frame_bytes, uint16_t word_);
 
-void CreateHaf(const std::string& output_filename, std::vector<std::string>& args, uint8_t word_,
-               const std::string& filename_end);
+// If compress is set, data of files is compressed if it makes them smaller (entries of such files get
+// compressed flag and coded sizes)
+void WriteFiles(const std::vector<InputFile>& files, std::vector<IncludedFile>& table, BufferedWriter& writer,
+                uint16_t word_, HafRevision revision, BlockLayout layout, bool compress = false);
 
-std::tuple<uint32_t, uint32_t, uint8_t> ReadHeader(std::ifstream& stream);
+void WriteFilesParallel(const std::vector<InputFile>& files, std::vector<IncludedFile>& table,
+                        BufferedWriter& writer, uint16_t word_, HafRevision revision, BlockLayout layout,
+                        unsigned threads, bool compress = false);
 
-std::vector<std::pair<std::string, uint32_t>> HafFilesList(const std::string& ha_file);
+// Arguments are files and directories. threads > 1 reads and codes files in parallel, archive is the same.
+// If dedup is set, files with the same data are stored once. If compress is set, files are compressed.
+// If target is set, words are chosen for it instead of word_
+void CreateHaf(const std::string& output_filename, std::vector<std::string>& args, uint16_t word_,
+               const std::string& filename_end, unsigned threads = 1, BlockLayout layout = BlockLayout::Packed,
+               bool dedup = false, bool compress = false, std::optional<ErrorTarget> target = std::nullopt);
 
-std::vector<std::string> ExtractHaf(const std::string& ha_file, const std::string& filename_end);
+// Only 64-bit revision may have interleaved layout
+std::vector<char> MakeHeader(uint64_t haf_size, uint64_t files_number, uint16_t word_, HafRevision revision,
+                             BlockLayout layout = BlockLayout::Packed);
+
+std::tuple<uint64_t, uint64_t, uint16_t, HafRevision, BlockLayout> ReadHeader(const FileReader& reader);
+
+// Decodes prefix of coded block, block_bytes gives size of block by decoded prefix (it is needed for aligned profiles)
+std::vector<char> DecodePrefix(const FileReader& reader, uint64_t offset, uint64_t data_bytes, uint16_t word_,
+                               const std::function<uint64_t(const std::vector<char>&)>& block_bytes);
+
+IncludedFile ReadFileHeader(const FileReader& reader, uint64_t offset, uint16_t word_, HafRevision revision);
+
+std::vector<IncludedFile> ScanFilesTable(const FileReader& reader, uint64_t files_number, uint16_t word_,
+                                         HafRevision revision);
+
+// Links of linked files of table made from directory are read from their blocks
+void ReadLinks(const FileReader& reader, std::vector<IncludedFile>& files, uint16_t word_, HafRevision revision);
+
+// Uses directory of Haf if it is present and not damaged, otherwise searches files by their headers.
+// Deleted files are in table too
+std::vector<IncludedFile> ReadFilesTable(const FileReader& reader, uint64_t haf_size, uint64_t files_number,
+                                         uint16_t word_, HafRevision revision);
+
+std::vector<std::pair<std::string, uint64_t>> HafFilesList(const std::string& ha_file);
+
+uint64_t DecodeBlock(const FileReader& reader, uint64_t offset, uint64_t data_bytes, uint16_t word_,
+                     BlockLayout layout, uint64_t skipped_bytes,
+                     const std::function<void(const char*, size_t)>& consume);
+
+// Calls frame for offset and data bytes of every frame with its compressed flag, returns size of file
+// and coded size of its frames
+std::pair<uint64_t, uint64_t> ReadFrames(const FileReader& reader, uint64_t offset, uint16_t word_,
+                                         const std::function<void(uint64_t, uint64_t, bool)>& frame);
+
+// Decodes data of included file by parts, header of file is skipped, data of linked file is decoded from block
+// it links to. Returns coded size of file (size of streamed file read from pipe is known only after its frames)
+uint64_t DecodeFile(const FileReader& reader, const IncludedFile& file, uint16_t word_, HafRevision revision,
+                    BlockLayout layout, const std::function<void(const char*, size_t)>& consume);
+
+uint64_t ExtractFile(const FileReader& reader, const IncludedFile& file, uint16_t word_, HafRevision revision,
+                     BlockLayout layout, const std::string& output_filename);
+
+// threads > 1 decodes files concurrently from one mapping of Haf, Haf from pipe is extracted in one pass
+// (data of blocks which files linked later may need is kept in temporary file).
+// Files are written to directory of Haf, files of Haf from pipe are written to the current directory.
+// Directories of included files are created, names leading out of directory of extraction are rejected.
+// If names are given, only files with these names are extracted. If to_stdout is set, data of files is written
+// to stdout one after another
+std::vector<std::string> ExtractHaf(const std::string& ha_file, const std::string& filename_end,
+                                    unsigned threads = 1, const std::vector<std::string>& names = {},
+                                    bool to_stdout = false);
 
 void AppendFilesToHaf(const std::string& output_filename, std::vector<std::string>& args);
 
-void DeleteFilesFromHaf(const std::string& output_filename, std::vector<std::string>& args);
+// Marks file as deleted in its header, block of file is not changed otherwise
+// (header is in packed prefix of block of any layout)
+void MarkFileDeleted(const FileReader& reader, int output_fd, const IncludedFile& file, uint16_t word_);
+
+void RewriteHaf(const std::string& output_filename, const FileReader& reader, std::vector<IncludedFile> kept_files,
+                uint16_t word_, HafRevision revision, BlockLayout layout);
+
+// Haf is written again without deleted files, blocks of other files are copied without decoding.
+// If tombstone is set, files of 64-bit Haf are only marked deleted in place
+void DeleteFilesFromHaf(const std::string& output_filename, std::vector<std::string>& args, bool tombstone = false);
+
+// Removes blocks of files marked deleted
+void CompactHaf(const std::string& ha_file);
 
+// Part of block from its group first_group (the beginning of slice). If repair_fd is set, bytes of corrected
+// codewords are written back to it, other bytes are not written
+CodewordErrors CheckBlock(const FileReader& reader, uint64_t offset, uint64_t data_bytes, uint16_t word_,
+                          BlockLayout layout, uint64_t first_group, int repair_fd = -1);
+
+// Checks codewords of Haf header, all files and directory by threads workers without writing anything, prints
+// errors of every file and speed. Returns total errors, size of Haf differing from its blocks with directory is
+// one uncorrectable codeword. If repair is set, corrected bits are written back to Haf in place
+// (and its header and directory are repaired too), uncorrectable codewords are left as they are
+CodewordErrors VerifyHaf(const std::string& ha_file, unsigned threads = 1, bool repair = false);
+
+void TranscodeFile(const FileReader& reader, const IncludedFile& file, uint16_t word_, HafRevision revision,
+                   BlockLayout layout, uint16_t new_word, BlockLayout new_layout, BufferedWriter& writer,
+                   ThreadPool& coder);
+
+void MergeHaf(const std::string& output_filename, const std::vector<std::string>& args, uint16_t word_,
+              std::optional<BlockLayout> layout);
+
+// Coded blocks of files are copied without decoding if all Haf have the same word length and layout,
+// otherwise files are coded again with 11-bit words (packed if layouts differ)
 void ConcatenateHaf(const std::string& output_filename, std::vector<std::string>& args);
+
+// Codes files of Haf again with new word length and layout, file by file without writing decoded data
+void TranscodeHaf(const std::string& ha_file, uint16_t word_, BlockLayout layout = BlockLayout::Packed);
@@ -0,0 +1,121 @@
+#include "checksum.h"
+
+#include <array>
+#include <cstring>
+
+namespace {
+
+std::array<uint32_t, 256> BuildCrcTable() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        uint32_t crc = byte;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320u : 0);
+        }
+        table[byte] = crc;
+    }
+    return table;
+}
+
+const std::array<uint32_t, 256> crc_table = BuildCrcTable();
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+uint64_t RotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t Round(uint64_t lane, uint64_t input) {
+    return RotateLeft(lane + input * kPrime2, 31) * kPrime1;
+}
+
+uint64_t MergeRound(uint64_t hash, uint64_t lane) {
+    return (hash ^ Round(0, lane)) * kPrime1 + kPrime4;
+}
+
+template<class T>
+T Load(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+} // namespace
+
+uint32_t Crc32(const char* data, size_t size, uint32_t crc) {
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = (crc >> 8) ^ crc_table[(crc ^ (uint8_t) data[i]) & 0xFF];
+    }
+    return ~crc;
+}
+
+Hash64::Hash64(uint64_t seed)
+    : lanes_{seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1},
+      seed_(seed) {}
+
+void Hash64::Update(const char* data, size_t size) {
+    total_size_ += size;
+    if (stripe_size_ + size < sizeof(stripe_)) {
+        std::memcpy(stripe_ + stripe_size_, data, size);
+        stripe_size_ += size;
+        return;
+    }
+    if (stripe_size_) {
+        size_t taken = sizeof(stripe_) - stripe_size_;
+        std::memcpy(stripe_ + stripe_size_, data, taken);
+        for (int lane = 0; lane < 4; lane++) {
+            lanes_[lane] = Round(lanes_[lane], Load<uint64_t>(stripe_ + 8 * lane));
+        }
+        data += taken;
+        size -= taken;
+        stripe_size_ = 0;
+    }
+    // Lanes are independent, so rounds of one stripe run in parallel
+    for (; size >= sizeof(stripe_); data += sizeof(stripe_), size -= sizeof(stripe_)) {
+        for (int lane = 0; lane < 4; lane++) {
+            lanes_[lane] = Round(lanes_[lane], Load<uint64_t>(data + 8 * lane));
+        }
+    }
+    std::memcpy(stripe_, data, size);
+    stripe_size_ = size;
+}
+
+uint64_t Hash64::Digest() const {
+    uint64_t hash;
+    if (total_size_ >= sizeof(stripe_)) {
+        hash = RotateLeft(lanes_[0], 1) + RotateLeft(lanes_[1], 7) + RotateLeft(lanes_[2], 12) +
+               RotateLeft(lanes_[3], 18);
+        for (uint64_t lane: lanes_) {
+            hash = MergeRound(hash, lane);
+        }
+    } else {
+        hash = seed_ + kPrime5;
+    }
+    hash += total_size_;
+
+    // Tail of data shorter than stripe
+    const char* tail = stripe_;
+    size_t size = stripe_size_;
+    for (; size >= 8; tail += 8, size -= 8) {
+        hash = RotateLeft(hash ^ Round(0, Load<uint64_t>(tail)), 27) * kPrime1 + kPrime4;
+    }
+    if (size >= 4) {
+        hash = RotateLeft(hash ^ (Load<uint32_t>(tail) * kPrime1), 23) * kPrime2 + kPrime3;
+        tail += 4;
+        size -= 4;
+    }
+    for (; size > 0; tail++, size--) {
+        hash = RotateLeft(hash ^ ((uint8_t) *tail * kPrime5), 11) * kPrime1;
+    }
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
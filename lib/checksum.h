@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 (IEEE 802.3), crc of previous part of data may be passed to continue it
+uint32_t Crc32(const char* data, size_t size, uint32_t crc = 0);
+
+// 64-bit hash of data given by parts (XXH64), it is much faster than CRC but does not detect errors as well
+class Hash64 {
+public:
+    explicit Hash64(uint64_t seed = 0);
+
+    void Update(const char* data, size_t size);
+
+    // Hash of all parts, more parts may be added after it
+    uint64_t Digest() const;
+
+private:
+    uint64_t lanes_[4];
+    // Data of incomplete stripe of 32 bytes
+    char stripe_[32];
+    size_t stripe_size_ = 0;
+    uint64_t total_size_ = 0;
+    uint64_t seed_;
+};
@@ -0,0 +1,108 @@
+#include "directory.h"
+#include "checksum.h"
+
+#include <cstring>
+
+namespace {
+
+template<class T>
+void Append(std::vector<char>& data, T value) {
+    data.insert(data.end(), (char*) &value, (char*) &value + sizeof(value));
+}
+
+template<class T>
+T Take(const std::vector<char>& data, size_t& position) {
+    T value;
+    std::memcpy(&value, data.data() + position, sizeof(value));
+    position += sizeof(value);
+    return value;
+}
+
+} // namespace
+
+std::vector<char> MakeDirectoryEntries(const std::vector<IncludedFile>& files) {
+    std::vector<char> entries;
+    for (const auto& file: files) {
+        AppendFileName(entries, file.name);
+        Append<uint64_t>(entries, file.size | (file.deleted ? DELETED_FILE_FLAG : 0) |
+                                  (file.streamed ? STREAMED_FILE_FLAG : 0) | (file.linked ? LINKED_FILE_FLAG : 0) |
+                                  (file.compressed ? COMPRESSED_FILE_FLAG : 0) | (file.word ? OWN_WORD_FILE_FLAG : 0));
+        Append<uint64_t>(entries, file.offset);
+        Append<uint64_t>(entries, file.coded_size);
+        if (file.word) Append<uint16_t>(entries, file.word);
+    }
+    return entries;
+}
+
+std::vector<char> MakeDirectory(const std::vector<IncludedFile>& files) {
+    auto entries = MakeDirectoryEntries(files);
+    std::vector<char> trailer = {'H', 'D'};
+    Append<uint32_t>(trailer, entries.size());
+    Append<uint32_t>(trailer, Crc32(entries.data(), entries.size()));
+    Append<uint8_t>(trailer, 0);
+
+    std::vector<char> coded;
+    HammingEncoder encoder(DEFAULT_LENGTH);
+    encoder.Update(entries.data(), entries.size(), coded);
+    encoder.Finish(coded);
+    encoder.Update(trailer.data(), trailer.size(), coded);
+    encoder.Finish(coded);
+    return coded;
+}
+
+std::optional<std::vector<IncludedFile>> ReadDirectory(const FileReader& reader, uint64_t haf_size,
+                                                       uint64_t files_number, uint64_t data_begin) {
+    if (haf_size < data_begin + DIRECTORY_TRAILER_SIZE) return std::nullopt;
+    std::vector<char> buffer;
+    auto coded_trailer = reader.Read(haf_size - DIRECTORY_TRAILER_SIZE, DIRECTORY_TRAILER_SIZE, buffer);
+    if (coded_trailer.size() != DIRECTORY_TRAILER_SIZE) return std::nullopt;
+    std::vector<char> trailer;
+    HammingDecoder(DEFAULT_LENGTH, HEADER_SIZE_WITHOUT_CODING).Update(coded_trailer.data(), DIRECTORY_TRAILER_SIZE,
+                                                                      trailer);
+    size_t position = 0;
+    if (Take<char>(trailer, position) != 'H' || Take<char>(trailer, position) != 'D') return std::nullopt;
+    uint32_t directory_size = Take<uint32_t>(trailer, position);
+    uint32_t directory_crc = Take<uint32_t>(trailer, position);
+
+    uint64_t coded_size = EncodedSize(DEFAULT_LENGTH, directory_size);
+    if (coded_size > haf_size - data_begin - DIRECTORY_TRAILER_SIZE) return std::nullopt;
+    uint64_t directory_offset = haf_size - DIRECTORY_TRAILER_SIZE - coded_size;
+    auto coded = reader.Read(directory_offset, coded_size, buffer);
+    if (coded.size() != coded_size) return std::nullopt;
+    std::vector<char> entries;
+    HammingDecoder(DEFAULT_LENGTH, directory_size).Update(coded.data(), coded.size(), entries);
+    if (Crc32(entries.data(), entries.size()) != directory_crc) return std::nullopt;
+
+    // Entries must follow each other between Haf header and directory
+    std::vector<IncludedFile> files;
+    position = 0;
+    uint64_t data_end = data_begin;
+    for (uint64_t i = 0; i < files_number; i++) {
+        if (position + INCLUDED_FILE_NAME_SIZE + LONG_FILE_NAME_SIZE > entries.size()) return std::nullopt;
+        auto [name_field_size, filename_size] = FileNameSize(entries.data() + position);
+        if (position + name_field_size + DIRECTORY_ENTRY_NUMBERS_SIZE > entries.size()) return std::nullopt;
+        IncludedFile file;
+        file.name.assign(entries.data() + position + name_field_size - filename_size, filename_size);
+        position += name_field_size;
+        file.size = Take<uint64_t>(entries, position);
+        file.deleted = file.size & DELETED_FILE_FLAG;
+        file.streamed = file.size & STREAMED_FILE_FLAG;
+        file.linked = file.size & LINKED_FILE_FLAG;
+        file.compressed = file.size & COMPRESSED_FILE_FLAG;
+        bool own_word = file.size & OWN_WORD_FILE_FLAG;
+        file.size &= ~(DELETED_FILE_FLAG | STREAMED_FILE_FLAG | LINKED_FILE_FLAG | COMPRESSED_FILE_FLAG |
+                       OWN_WORD_FILE_FLAG);
+        file.offset = Take<uint64_t>(entries, position);
+        file.coded_size = Take<uint64_t>(entries, position);
+        if (own_word) {
+            if (position + FILE_WORD_SIZE > entries.size()) return std::nullopt;
+            file.word = Take<uint16_t>(entries, position);
+            if (!IsValidWord(file.word)) return std::nullopt;
+        }
+        if (file.offset < data_end || file.coded_size > directory_offset - file.offset) return std::nullopt;
+        data_end = file.offset + file.coded_size;
+        files.push_back(std::move(file));
+    }
+    if (position != entries.size()) return std::nullopt;
+    return files;
+}
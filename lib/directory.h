@@ -0,0 +1,32 @@
+#pragma once
+
+#include "bitstream.h"
+
+#include <optional>
+#include <vector>
+
+/*
+ * Directory of Haf is placed after the last included file: [coded entries][coded trailer]
+ * Entries are coded as one block with 11-bit words: n entries of structure
+ * [file_name_size][file_name][file_size][offset][coded_size]
+ * file_name_size - 1B, file_name < 255B, file_size - 8B, offset - 8B, coded_size - 8B
+ * Long name is [0][long_file_name_size][file_name] as in header of file
+ * Upper bits of file_size are DELETED_FILE_FLAG, STREAMED_FILE_FLAG, LINKED_FILE_FLAG, COMPRESSED_FILE_FLAG and
+ * OWN_WORD_FILE_FLAG as in header of file, link of linked file is read from its block. Entry of file with its own
+ * word ends with the word: [file_name_size][file_name][file_size][offset][coded_size][word], word - 2B
+ * Trailer is coded as Haf header: [type_code][directory_size][directory_crc][reserved]
+ * type_code - 2B ("HD"), directory_size - 4B (entries without coding), directory_crc - 4B, reserved - 1B
+ */
+#define DIRECTORY_TRAILER_SIZE HEADER_SIZE
+#define DIRECTORY_ENTRY_NUMBERS_SIZE 24
+
+// Entries of directory without coding
+std::vector<char> MakeDirectoryEntries(const std::vector<IncludedFile>& files);
+
+// Coded directory with trailer
+std::vector<char> MakeDirectory(const std::vector<IncludedFile>& files);
+
+// Directory of Haf of haf_size bytes whose data starts at data_begin, nullopt if it is damaged
+// (errors were not corrected, so checksum differs, or entries do not fit into data of Haf)
+std::optional<std::vector<IncludedFile>> ReadDirectory(const FileReader& reader, uint64_t haf_size,
+                                                       uint64_t files_number, uint64_t data_begin);
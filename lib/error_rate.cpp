@@ -0,0 +1,105 @@
+#include "error_rate.h"
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+struct Media {
+    const char* name;
+    double bit_error_rate;
+};
+
+// Rough rates of wrong bits which pass through correction of media itself (channel is noisy line without it)
+const Media kMedia[] = {{"hdd",     1e-14},
+                        {"ssd",     1e-15},
+                        {"flash",   1e-9},
+                        {"optical", 1e-12},
+                        {"tape",    1e-19},
+                        {"channel", 1e-4}};
+
+// Whole string is number, otherwise NaN
+double ParseNumber(const std::string& name) {
+    size_t parsed = 0;
+    double number = NAN;
+    try {
+        number = std::stod(name, &parsed);
+    } catch (const std::exception&) {}
+    return parsed != 0 && parsed == name.size() ? number : NAN;
+}
+
+// Probability of more than one wrong bit among length bits
+double UncorrectedProbability(double length, double p) {
+    if (length * p >= 1e-3) return 1 - std::exp(length * std::log1p(-p)) - length * p *
+                                       std::exp((length - 1) * std::log1p(-p));
+    // Difference of probabilities close to 1 loses all digits, so terms C(length, j) p^j (1 - p)^(length - j)
+    // are summed while they matter
+    double term = length * (length - 1) / 2 * p * p * std::exp((length - 2) * std::log1p(-p));
+    double sum = 0;
+    for (double wrong = 2; wrong <= length && term > sum * 1e-17; wrong++) {
+        sum += term;
+        term *= (length - wrong) / (wrong + 1) * p / (1 - p);
+    }
+    return sum;
+}
+
+} // namespace
+
+double MediaErrorRate(const std::string& media) {
+    for (const auto& known: kMedia) {
+        if (media == known.name) return known.bit_error_rate;
+    }
+    double rate = ParseNumber(media);
+    if (!(rate > 0 && rate < 0.5))
+        throw std::runtime_error("Media must be hdd, ssd, flash, optical, tape, channel or bit error rate "
+                                 "in range (0, 0.5), not " + media);
+    return rate;
+}
+
+double ParseErrorRate(const std::string& name) {
+    double rate = ParseNumber(name);
+    if (!(rate > 0 && rate < 1))
+        throw std::runtime_error("Residual error rate must be in range (0, 1), not " + name);
+    return rate;
+}
+
+double ResidualErrorRate(uint16_t word, double bit_error_rate, double damaged_bits) {
+    double length = CodewordLength(word);
+    double data_bits = GroupDataBytes(word);
+    // Two wrong bits are corrected to the third one, aligned profiles detect them and leave them as they are
+    double wrong_bits = damaged_bits > 0 ? damaged_bits
+                                         : (word & ALIGNED_PROFILE_FLAG ? 2 : 3) * data_bits / length;
+    return UncorrectedProbability(length, bit_error_rate) * wrong_bits / data_bits;
+}
+
+std::string ErrorTargetName(const ErrorTarget& target) {
+    std::ostringstream name;
+    name << target.residual_rate << " on media with bit error rate " << target.bit_error_rate;
+    return name.str();
+}
+
+uint16_t ChooseWord(const ErrorTarget& target, double damaged_bits, BlockLayout layout,
+                    const std::function<uint64_t(uint16_t)>& coded_size) {
+    uint16_t best_word = 0;
+    uint64_t best_size = 0;
+    double best_rate = 0;
+    auto consider = [&](uint16_t word) {
+        double rate = ResidualErrorRate(word, target.bit_error_rate, damaged_bits);
+        if (rate > target.residual_rate) return;
+        uint64_t size = coded_size(word);
+        if (best_word == 0 || size < best_size || (size == best_size && rate < best_rate)) {
+            best_word = word;
+            best_size = size;
+            best_rate = rate;
+        }
+    };
+    for (uint16_t word = 1; word <= UINT8_MAX; word++) {
+        consider(word);
+    }
+    if (layout == BlockLayout::Packed) {
+        consider(SECDED_72_64);
+        consider(SECDED_137_128);
+    }
+    return best_word;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "hamming.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Target of adaptive choice of words: expected wrong data bits per data bit after decoding (residual_rate)
+// on media whose bits are wrong with probability bit_error_rate
+struct ErrorTarget {
+    double residual_rate;
+    double bit_error_rate;
+};
+
+// Bit error rate of media class (hdd, ssd, flash, optical, tape or channel) or bit error rate itself ("1e-9")
+double MediaErrorRate(const std::string& media);
+
+// Residual error rate given as number in range (0, 1), throws for others
+double ParseErrorRate(const std::string& name);
+
+// Expected wrong data bits per data bit after decoding data coded with word. Codeword with more than one wrong bit
+// is not corrected, it damages damaged_bits of data or, if damaged_bits is 0, its own bits
+double ResidualErrorRate(uint16_t word, double bit_error_rate, double damaged_bits = 0);
+
+// Target as it is given in command line: "1e-15 on media with bit error rate 1e-12"
+std::string ErrorTargetName(const ErrorTarget& target);
+
+// Word which meets target with the smallest coded_size of data (the strongest of such words), 0 if no word meets it.
+// Aligned profiles are not chosen for interleaved layout
+uint16_t ChooseWord(const ErrorTarget& target, double damaged_bits, BlockLayout layout,
+                    const std::function<uint64_t(uint16_t)>& coded_size);
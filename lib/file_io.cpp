@@ -0,0 +1,361 @@
+#include "file_io.h"
+#include "async_io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+size_t io_buffer_size = DEFAULT_IO_BUFFER_SIZE;
+unsigned io_queue_depth = DEFAULT_IO_QUEUE_DEPTH;
+unsigned io_buffers = DEFAULT_IO_BUFFERS;
+
+} // namespace
+
+void SetIoBufferSize(size_t size) {
+    if (size < MIN_IO_BUFFER_SIZE || size > MAX_IO_BUFFER_SIZE)
+        throw std::runtime_error("Buffer size must be from " + std::to_string(MIN_IO_BUFFER_SIZE >> 20) + " to " +
+                                 std::to_string(MAX_IO_BUFFER_SIZE >> 20) + " MiB");
+    io_buffer_size = size;
+}
+
+size_t IoBufferSize() {
+    return io_buffer_size;
+}
+
+void SetIoQueue(unsigned queue_depth, unsigned buffers) {
+    if (queue_depth == 0 || queue_depth > MAX_IO_QUEUE_DEPTH)
+        throw std::runtime_error("Queue depth of I/O must be from 1 to " + std::to_string(MAX_IO_QUEUE_DEPTH));
+    if (buffers == 0 || buffers > MAX_IO_BUFFERS)
+        throw std::runtime_error("Number of I/O buffers must be from 1 to " + std::to_string(MAX_IO_BUFFERS));
+    io_queue_depth = queue_depth;
+    io_buffers = buffers;
+}
+
+unsigned IoQueueDepth() {
+    return io_queue_depth;
+}
+
+unsigned IoBuffers() {
+    return io_buffers;
+}
+
+void FreeIoBuffer::operator()(char* buffer) const {
+    std::free(buffer);
+}
+
+IoBuffer AllocateIoBuffer(size_t size) {
+    // aligned_alloc needs size multiple of alignment
+    size = (size + IO_BUFFER_ALIGNMENT - 1) / IO_BUFFER_ALIGNMENT * IO_BUFFER_ALIGNMENT;
+    IoBuffer buffer(static_cast<char*>(std::aligned_alloc(IO_BUFFER_ALIGNMENT, size)));
+    if (!buffer) throw std::bad_alloc();
+    return buffer;
+}
+
+FileDescriptor::FileDescriptor(const std::string& filename, int flags) : fd_(open(filename.c_str(), flags, 0644)) {
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to open " + filename + ": " + std::strerror(errno));
+    }
+}
+
+FileDescriptor::~FileDescriptor() {
+    close(fd_);
+}
+
+size_t ReadAt(int fd, char* data, size_t size, uint64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t read_bytes = pread(fd, data + done, size - done, (off_t) (offset + done));
+        if (read_bytes < 0 && errno == EINTR) continue;
+        if (read_bytes < 0) throw std::runtime_error(std::string("Failed to read: ") + std::strerror(errno));
+        if (read_bytes == 0) break;
+        done += read_bytes;
+    }
+    return done;
+}
+
+void WriteAt(int fd, const char* data, size_t size, uint64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t written_bytes = pwrite(fd, data + done, size - done, (off_t) (offset + done));
+        if (written_bytes < 0 && errno == EINTR) continue;
+        if (written_bytes <= 0) throw std::runtime_error(std::string("Failed to write: ") + std::strerror(errno));
+        done += written_bytes;
+    }
+}
+
+void CopyRange(int input_fd, uint64_t input_offset, int output_fd, uint64_t output_offset, uint64_t size) {
+    while (size > 0) {
+        auto in = (off_t) input_offset;
+        auto out = (off_t) output_offset;
+        ssize_t copied = copy_file_range(input_fd, &in, output_fd, &out, size, 0);
+        if (copied < 0 && errno == EINTR) continue;
+        if (copied < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) break;
+        if (copied < 0) throw std::runtime_error(std::string("Failed to copy: ") + std::strerror(errno));
+        if (copied == 0) throw std::runtime_error("Unexpected end of file while copying");
+        input_offset += copied;
+        output_offset += copied;
+        size -= copied;
+    }
+
+    std::vector<char> buffer(std::min<uint64_t>(size, IoBufferSize()));
+    while (size > 0) {
+        size_t read_bytes = ReadAt(input_fd, buffer.data(), std::min<uint64_t>(size, buffer.size()), input_offset);
+        if (read_bytes == 0) throw std::runtime_error("Unexpected end of file while copying");
+        WriteAt(output_fd, buffer.data(), read_bytes, output_offset);
+        input_offset += read_bytes;
+        output_offset += read_bytes;
+        size -= read_bytes;
+    }
+}
+
+ReplacingFile::ReplacingFile(const std::string& filename)
+    : filename_(filename), written_filename_(filename + ".tmp"),
+      file_(written_filename_, O_WRONLY | O_CREAT | O_TRUNC) {
+}
+
+ReplacingFile::~ReplacingFile() {
+    if (!replaced_) unlink(written_filename_.c_str());
+}
+
+void ReplacingFile::Replace() {
+    if (fsync(file_.Get()) != 0)
+        throw std::runtime_error("Failed to sync " + written_filename_ + ": " + std::strerror(errno));
+    if (rename(written_filename_.c_str(), filename_.c_str()) != 0)
+        throw std::runtime_error("Failed to replace " + filename_ + ": " + std::strerror(errno));
+    replaced_ = true;
+    // Renaming is durable when the directory entry is synced too
+    std::string directory = std::filesystem::path(filename_).parent_path();
+    if (directory.empty()) directory = ".";
+    FileDescriptor directory_fd(directory, O_RDONLY | O_DIRECTORY);
+    if (fsync(directory_fd.Get()) != 0)
+        throw std::runtime_error("Failed to sync " + directory + ": " + std::strerror(errno));
+}
+
+FileReader::FileReader(const std::string& filename) : filename_(filename) {
+    file_.emplace(filename, O_RDONLY);
+    struct stat status{};
+    if (fstat(file_->Get(), &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+        void* map = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file_->Get(), 0);
+        if (map != MAP_FAILED) {
+            map_ = static_cast<const char*>(map);
+            map_size_ = status.st_size;
+            return;
+        }
+    }
+    pipe_ = lseek(file_->Get(), 0, SEEK_CUR) < 0 && errno == ESPIPE;
+}
+
+FileReader::FileReader(std::string_view data)
+    : filename_("memory"),
+      map_(data.data()),
+      map_size_(data.size()) {}
+
+FileReader::~FileReader() {
+    if (map_ && file_) munmap(const_cast<char*>(map_), map_size_);
+}
+
+std::string_view FileReader::Read(uint64_t offset, uint64_t size, std::vector<char>& buffer) const {
+    if (map_ || !file_) {
+        if (offset >= map_size_) return {};
+        return {map_ + offset, std::min(size, map_size_ - offset)};
+    }
+    if (!pipe_) {
+        buffer.resize(size);
+        return {buffer.data(), ReadAt(file_->Get(), buffer.data(), size, offset)};
+    }
+
+    if (offset < window_begin_)
+        throw std::runtime_error(filename_ + " is a pipe, it can be read only forwards");
+    auto drop_before_offset = [&]() {
+        uint64_t dropped = std::min<uint64_t>(offset - window_begin_, window_.size());
+        window_.erase(window_.begin(), window_.begin() + (std::ptrdiff_t) dropped);
+        window_begin_ += dropped;
+    };
+    while (!pipe_ended_ && window_begin_ + window_.size() < offset + size) {
+        drop_before_offset();
+        // Skipped bytes are read by parts too, so window is not larger than size + PIPE_READ_SIZE
+        auto read_from = window_.size();
+        window_.resize(read_from + std::min<uint64_t>(offset + size - window_begin_ - read_from, PIPE_READ_SIZE));
+        ssize_t read_bytes = read(file_->Get(), window_.data() + read_from, window_.size() - read_from);
+        if (read_bytes < 0 && errno != EINTR)
+            throw std::runtime_error("Failed to read " + filename_ + ": " + std::strerror(errno));
+        pipe_ended_ = read_bytes == 0;
+        window_.resize(read_from + std::max<ssize_t>(read_bytes, 0));
+    }
+    drop_before_offset();
+    if (offset != window_begin_) return {};
+    return {window_.data(), std::min<uint64_t>(size, window_.size())};
+}
+
+uint64_t FileReader::Size() const {
+    if (map_ || !file_) return map_size_;
+    struct stat status{};
+    if (pipe_ || fstat(file_->Get(), &status) != 0) return 0;
+    return status.st_size;
+}
+
+void FileReader::AdviseSequential(uint64_t offset, uint64_t size) const {
+    if (!map_ || !file_ || offset >= map_size_) return;
+    // madvise needs the address aligned to page
+    static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t begin = offset / page_size * page_size;
+    uint64_t end = std::min(map_size_, offset + size);
+    madvise(const_cast<char*>(map_) + begin, end - begin, MADV_SEQUENTIAL);
+    madvise(const_cast<char*>(map_) + begin, end - begin, MADV_WILLNEED);
+}
+
+SequentialReader::SequentialReader(const FileReader& reader, uint64_t offset, uint64_t size)
+    : reader_(reader),
+      begin_(offset),
+      offset_(offset),
+      end_(size > UINT64_MAX - offset ? UINT64_MAX : offset + size),
+      part_size_(IoBufferSize()) {
+    // Views of mapped files and windows of pipes need no buffers
+    if (reader.Mapped() || !reader.Seekable() || IoBuffers() == 1) return;
+    buffers_.resize(IoBuffers());
+    for (auto& buffer: buffers_) {
+        buffer = AllocateIoBuffer(part_size_);
+    }
+    done_.assign(buffers_.size(), -1);
+    io_ = std::make_unique<AsyncIo>(std::min(IoQueueDepth(), IoBuffers()));
+    ReadAhead();
+}
+
+SequentialReader::~SequentialReader() = default;
+
+void SequentialReader::ReadAhead() {
+    while (submitted_parts_ < next_part_ + buffers_.size() && io_->InFlight() < io_->QueueDepth()) {
+        uint64_t part_begin = begin_ + submitted_parts_ * part_size_;
+        if (part_begin >= end_) return;
+        io_->Read(reader_.Descriptor(), buffers_[submitted_parts_ % buffers_.size()].get(),
+                  std::min(end_ - part_begin, part_size_), part_begin, submitted_parts_);
+        submitted_parts_++;
+    }
+}
+
+std::string_view SequentialReader::Next() {
+    if (offset_ >= end_) return {};
+    if (!io_) {
+        auto data = reader_.Read(offset_, std::min(end_ - offset_, part_size_), buffer_);
+        offset_ += data.size();
+        if (data.empty()) end_ = offset_;
+        return data;
+    }
+
+    // Buffer of the previous part is free now
+    ReadAhead();
+    size_t buffer = next_part_ % buffers_.size();
+    while (done_[buffer] < 0) {
+        auto [part, size] = io_->Wait();
+        done_[part % buffers_.size()] = (int64_t) size;
+        ReadAhead();
+    }
+    auto size = (uint64_t) done_[buffer];
+    done_[buffer] = -1;
+    // Short part is the end of file, parts after it are left in flight
+    if (size < std::min(end_ - offset_, part_size_)) end_ = offset_ + size;
+    std::string_view data(buffers_[buffer].get(), size);
+    offset_ += size;
+    next_part_++;
+    return data;
+}
+
+BufferedWriter::BufferedWriter(int fd, uint64_t offset)
+    : fd_(fd),
+      offset_(offset),
+      pipe_(lseek(fd, 0, SEEK_CUR) < 0 && errno == ESPIPE),
+      // Pipe is written only by write, it gets one buffer
+      max_buffers_(pipe_ ? 1 : IoBuffers()),
+      capacity_(IoBufferSize()) {
+    buffers_.push_back(AllocateIoBuffer(capacity_));
+    in_flight_.push_back(false);
+}
+
+BufferedWriter::~BufferedWriter() = default;
+
+void BufferedWriter::Write(const char* data, size_t size) {
+    if (used_ + size > capacity_ && max_buffers_ > 1) {
+        // Buffers are filled and written behind, so caller goes on coding while they are written
+        while (used_ + size > capacity_) {
+            size_t part = capacity_ - used_;
+            std::memcpy(buffers_[current_].get() + used_, data, part);
+            used_ += part;
+            data += part;
+            size -= part;
+            WriteBehind();
+        }
+    } else if (used_ + size > capacity_) {
+        Flush();
+        // Large blocks (ex. views of mapped files) are written without copying
+        if (size >= capacity_) {
+            WriteOut(data, size);
+            return;
+        }
+    }
+    std::memcpy(buffers_[current_].get() + used_, data, size);
+    used_ += size;
+}
+
+void BufferedWriter::WriteBehind() {
+    if (!io_) io_ = std::make_unique<AsyncIo>(IoQueueDepth());
+    while (io_->InFlight() >= io_->QueueDepth()) {
+        in_flight_[io_->Wait().first] = false;
+    }
+    io_->Write(fd_, buffers_[current_].get(), used_, offset_, current_);
+    in_flight_[current_] = true;
+    offset_ += used_;
+    used_ = 0;
+
+    // Free buffer, new one while there are less than max_buffers_, otherwise the first written one
+    auto free = std::find(in_flight_.begin(), in_flight_.end(), false);
+    if (free == in_flight_.end() && buffers_.size() < max_buffers_) {
+        buffers_.push_back(AllocateIoBuffer(capacity_));
+        in_flight_.push_back(false);
+        free = in_flight_.end() - 1;
+    }
+    while (free == in_flight_.end()) {
+        in_flight_[io_->Wait().first] = false;
+        free = std::find(in_flight_.begin(), in_flight_.end(), false);
+    }
+    current_ = free - in_flight_.begin();
+}
+
+void BufferedWriter::Seek(uint64_t offset) {
+    Flush();
+    if (pipe_ && offset != offset_)
+        throw std::runtime_error("Output is a pipe, it can be written only forwards");
+    offset_ = offset;
+}
+
+void BufferedWriter::Flush() {
+    WriteOut(buffers_[current_].get(), used_);
+    used_ = 0;
+    while (io_ && io_->InFlight()) {
+        in_flight_[io_->Wait().first] = false;
+    }
+}
+
+void BufferedWriter::WriteOut(const char* data, size_t size) {
+    if (!pipe_) {
+        WriteAt(fd_, data, size, offset_);
+        offset_ += size;
+        return;
+    }
+    for (size_t done = 0; done < size;) {
+        ssize_t written_bytes = write(fd_, data + done, size - done);
+        if (written_bytes < 0 && errno == EINTR) continue;
+        if (written_bytes <= 0) throw std::runtime_error(std::string("Failed to write: ") + std::strerror(errno));
+        done += written_bytes;
+    }
+    offset_ += size;
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define PIPE_READ_SIZE (1 << 20)
+// Size of buffers of reads and writes: default, limits and alignment (buffers may be used with O_DIRECT)
+#define DEFAULT_IO_BUFFER_SIZE (1 << 20)
+#define MIN_IO_BUFFER_SIZE (1 << 20)
+#define MAX_IO_BUFFER_SIZE (1 << 28)
+#define IO_BUFFER_ALIGNMENT 4096
+// Requests of background I/O in flight and buffers read ahead of coding or written behind it (1 is synchronous I/O)
+#define DEFAULT_IO_QUEUE_DEPTH 8
+#define MAX_IO_QUEUE_DEPTH 256
+#define DEFAULT_IO_BUFFERS 4
+#define MAX_IO_BUFFERS 64
+
+class AsyncIo;
+
+// Buffer size used by all readers and writers of Haf, throws if size is out of limits
+void SetIoBufferSize(size_t size);
+
+size_t IoBufferSize();
+
+// Queue depth and number of buffers of background I/O, throws if they are out of limits
+void SetIoQueue(unsigned queue_depth, unsigned buffers);
+
+unsigned IoQueueDepth();
+
+unsigned IoBuffers();
+
+struct FreeIoBuffer {
+    void operator()(char* buffer) const;
+};
+
+using IoBuffer = std::unique_ptr<char, FreeIoBuffer>;
+
+// Buffer aligned to IO_BUFFER_ALIGNMENT, throws std::bad_alloc
+IoBuffer AllocateIoBuffer(size_t size);
+
+// POSIX descriptor owned by object, shared between threads doing positioned reads and writes
+class FileDescriptor {
+public:
+    // flags as for open(2), new files are created with mode 0644
+    FileDescriptor(const std::string& filename, int flags);
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    ~FileDescriptor();
+
+    int Get() const {
+        return fd_;
+    }
+
+private:
+    int fd_;
+};
+
+// Reads up to size bytes from offset, returns number of read bytes (less than size only at the end of file)
+size_t ReadAt(int fd, char* data, size_t size, uint64_t offset);
+
+// Writes all size bytes to offset or throws
+void WriteAt(int fd, const char* data, size_t size, uint64_t offset);
+
+// Copies size bytes between files inside kernel (copy_file_range), by pread and pwrite if it is not supported
+void CopyRange(int input_fd, uint64_t input_offset, int output_fd, uint64_t output_offset, uint64_t size);
+
+/*
+ * New contents of file written to filename.tmp. Replace syncs it to disk and renames it to filename, then syncs the
+ * directory, so file is replaced at once and is never missing or partially written, even after crash.
+ * Destructor removes .tmp which was not renamed
+ */
+class ReplacingFile {
+public:
+    explicit ReplacingFile(const std::string& filename);
+
+    ReplacingFile(const ReplacingFile&) = delete;
+    ReplacingFile& operator=(const ReplacingFile&) = delete;
+
+    ~ReplacingFile();
+
+    int Get() const {
+        return file_.Get();
+    }
+
+    void Replace();
+
+private:
+    std::string filename_;
+    std::string written_filename_;
+    FileDescriptor file_;
+    bool replaced_ = false;
+};
+
+/*
+ * Read-only access to file by offsets. Regular files are mapped to memory, so reads return views of the mapping
+ * without copying, files which can't be mapped are read with pread to the buffer of caller.
+ * Pipes are read only forwards: bytes before the offset of the last read are dropped, so they may be read by
+ * one thread only, and every view is valid until the next read.
+ * Reader of memory returns views of it as of mapped file, memory is not copied and must outlive reader.
+ */
+class FileReader {
+public:
+    explicit FileReader(const std::string& filename);
+
+    explicit FileReader(std::string_view data);
+
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    ~FileReader();
+
+    // Up to size bytes from offset (less only at the end of file), buffer is used if file is not mapped
+    std::string_view Read(uint64_t offset, uint64_t size, std::vector<char>& buffer) const;
+
+    // Offsets may be read in any order and from many threads
+    bool Seekable() const {
+        return !pipe_;
+    }
+
+    // Hint that range will be read sequentially soon
+    void AdviseSequential(uint64_t offset, uint64_t size) const;
+
+    // Views of Read are taken from memory without copying
+    bool Mapped() const {
+        return map_ || !file_;
+    }
+
+    // -1 for memory
+    int Descriptor() const {
+        return file_ ? file_->Get() : -1;
+    }
+
+    // Size of file, 0 for pipes
+    uint64_t Size() const;
+
+private:
+    std::string filename_;
+    std::optional<FileDescriptor> file_;
+    const char* map_ = nullptr;
+    uint64_t map_size_ = 0;
+    bool pipe_ = false;
+    // Bytes of pipe from window_begin_
+    mutable std::vector<char> window_;
+    mutable uint64_t window_begin_ = 0;
+    mutable bool pipe_ended_ = false;
+};
+
+/*
+ * Reads range of file forwards by parts of IoBufferSize() bytes. Parts of files which are not mapped (ex. devices)
+ * are read by AsyncIo into IoBuffers() buffers ahead of the part in use, mapped files are read ahead by kernel
+ * (AdviseSequential), pipes are read as they go. View of part is valid until the next call
+ */
+class SequentialReader {
+public:
+    // size may be larger than the rest of file (ex. of streamed file)
+    SequentialReader(const FileReader& reader, uint64_t offset, uint64_t size);
+
+    SequentialReader(const SequentialReader&) = delete;
+    SequentialReader& operator=(const SequentialReader&) = delete;
+
+    ~SequentialReader();
+
+    // Next part of range, empty at the end of range or of file
+    std::string_view Next();
+
+private:
+    // Submits reads of parts after the one in use while there are free buffers
+    void ReadAhead();
+
+    const FileReader& reader_;
+    uint64_t begin_;
+    uint64_t offset_;
+    uint64_t end_;
+    uint64_t part_size_;
+    std::vector<char> buffer_;
+    // Part i is read to buffer i % buffers, done_ has sizes of read parts by buffers (-1 if part is in flight)
+    std::vector<IoBuffer> buffers_;
+    std::vector<int64_t> done_;
+    uint64_t next_part_ = 0;
+    uint64_t submitted_parts_ = 0;
+    // Destroyed before buffers, waiting for their reads
+    std::unique_ptr<AsyncIo> io_;
+};
+
+/*
+ * Output to file through aligned buffers of IoBufferSize() bytes, written with pwrite from the current offset,
+ * so writers of different offsets may share descriptor. Full buffers are written behind by AsyncIo while the next
+ * ones are filled (IoBuffers() buffers at most), Flush waits for all of them. Buffer must be flushed explicitly,
+ * destructor drops it. Pipes are written with write only forwards, offset only counts written bytes
+ */
+class BufferedWriter {
+public:
+    BufferedWriter(int fd, uint64_t offset);
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    ~BufferedWriter();
+
+    void Write(const char* data, size_t size);
+
+    void Write(std::string_view data) {
+        Write(data.data(), data.size());
+    }
+
+    // Writes buffered bytes and moves to offset
+    void Seek(uint64_t offset);
+
+    bool Seekable() const {
+        return !pipe_;
+    }
+
+    void Flush();
+
+    // Offset of the next written byte
+    uint64_t Offset() const {
+        return offset_ + used_;
+    }
+
+private:
+    void WriteOut(const char* data, size_t size);
+
+    // Writes current buffer behind and takes a free one
+    void WriteBehind();
+
+    int fd_;
+    uint64_t offset_;
+    bool pipe_;
+    // Buffers are added up to IoBuffers() as they are needed, current_ is filled, the others may be in flight
+    std::vector<IoBuffer> buffers_;
+    std::vector<bool> in_flight_;
+    size_t current_ = 0;
+    size_t max_buffers_;
+    size_t capacity_;
+    size_t used_ = 0;
+    // Destroyed before buffers, waiting for their writes
+    std::unique_ptr<AsyncIo> io_;
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+// Public interface of hamarc library: Hamming codec of memory, Haf archives with sinks and file-level commands
+
+#include "archive.h"
+#include "bitstream.h"
+#include "hamming.h"
+
+// Streaming codec of one block: span versions of Update and Finish work on memory of caller
+using Encoder = HammingEncoder;
+using Decoder = HammingDecoder;
@@ -0,0 +1,1003 @@
+#include "hamming.h"
+#include "bitpack.h"
+#include "hamming_kernels.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+uint8_t CountAddedBits(uint8_t word) {
+    // Control bits depends on word length
+    // Calculated with formula 2^added_bits_per_word >= added_bits_per_word + word_length + 1
+    switch (word) {
+        case 0:
+            throw std::logic_error("Word length must be in range 1 ... 255");
+        case 1:
+            return 2;
+        case 2 ... 4:
+            return 3;
+        case 5 ... 11:
+            return 4;
+        case 12 ... 26:
+            return 5;
+        case 27 ... 57:
+            return 6;
+        case 58 ... 120:
+            return 7;
+        case 121 ... 247:
+            return 8;
+        default:
+            return 9;
+    }
+}
+
+bool IsValidWord(uint16_t word) {
+    return (word >= 1 && word <= UINT8_MAX) || word == SECDED_72_64 || word == SECDED_137_128;
+}
+
+uint16_t ParseWord(const std::string& name) {
+    if (name == "72,64") return SECDED_72_64;
+    if (name == "137,128") return SECDED_137_128;
+    size_t parsed = 0;
+    int word = 0;
+    try {
+        word = std::stoi(name, &parsed);
+    } catch (const std::exception&) {}
+    if (parsed == 0 || parsed != name.size() || word < 1 || word > UINT8_MAX)
+        throw std::runtime_error("Word must be word length 1 ... 255 or aligned profile 72,64 or 137,128, not " + name);
+    return word;
+}
+
+std::string WordName(uint16_t word) {
+    if (word & ALIGNED_PROFILE_FLAG)
+        return "(" + std::to_string(CodewordLength(word)) + "," + std::to_string(GroupDataBytes(word)) + ") SECDED";
+    return std::to_string(word) + "bit";
+}
+
+uint16_t CodewordLength(uint16_t word) {
+    // Aligned profiles have the overall parity bit after control bits
+    uint8_t data_bits = GroupDataBytes(word);
+    return data_bits + CountAddedBits(data_bits) + (word & ALIGNED_PROFILE_FLAG ? 1 : 0);
+}
+
+namespace {
+
+HammingCode BuildHammingCode(uint8_t word) {
+    HammingCode code{};
+    code.word = word;
+    code.extra_bits = CountAddedBits(word);
+    code.length = word + code.extra_bits;
+    code.data_limbs = (word + 63) / 64;
+    code.code_limbs = (code.length + 63) / 64;
+    code.code_bytes = (code.length + CHAR_BIT - 1) / CHAR_BIT;
+
+    // Data bits are split into runs between control bits and limb borders
+    uint32_t data_pos = 0;
+    for (uint32_t pos = 1; pos <= code.length; pos++) {
+        if ((pos & (pos - 1)) == 0) continue;
+        uint32_t code_pos = pos - 1;
+        auto right = (uint8_t) (code_pos % 64 > data_pos % 64 ? code_pos % 64 - data_pos % 64 : 0);
+        auto left = (uint8_t) (data_pos % 64 > code_pos % 64 ? data_pos % 64 - code_pos % 64 : 0);
+        HammingCode::Piece* last = code.pieces_count ? &code.pieces[code.pieces_count - 1] : nullptr;
+        bool continues = last && last->data_limb == data_pos / 64 && last->code_limb == code_pos / 64 &&
+                         last->right == right && last->left == left && (last->mask & LimbBit(data_pos - 1));
+        if (!continues) {
+            if (code.pieces_count == MAX_CODE_PIECES) throw std::logic_error("Too many pieces in Hamming code");
+            last = &code.pieces[code.pieces_count++];
+            *last = {0, (uint8_t) (data_pos / 64), (uint8_t) (code_pos / 64), right, left};
+        }
+        last->mask |= LimbBit(data_pos);
+        data_pos++;
+    }
+
+    for (uint32_t byte = 0; byte < code.code_bytes; byte++) {
+        for (uint32_t value = 0; value < 256; value++) {
+            uint16_t syndrome = 0;
+            for (uint32_t bit = 0; bit < CHAR_BIT; bit++) {
+                uint32_t pos = byte * CHAR_BIT + bit + 1;
+                if ((value & (0x80 >> bit)) && pos <= code.length) syndrome ^= pos;
+            }
+            code.parity_table[byte][value] = syndrome;
+        }
+    }
+    for (uint32_t syndrome = 0; syndrome < 128; syndrome++) {
+        for (uint32_t bit = 0; bit < 7; bit++) {
+            if (syndrome & (1u << bit)) code.control_bits[syndrome] |= LimbBit((1u << bit) - 1);
+        }
+    }
+    data_pos = 0;
+    for (uint32_t pos = 1; pos <= code.length; pos++) {
+        if ((pos & (pos - 1)) == 0) continue;
+        code.corrections[data_pos / 64][pos] = LimbBit(data_pos);
+        data_pos++;
+    }
+    for (uint8_t bit = 0; bit < code.extra_bits; bit++) {
+        for (uint32_t pos = 1; pos <= code.length; pos++) {
+            if (pos & (1u << bit)) code.parity_masks[bit][(pos - 1) / 64] |= LimbBit(pos - 1);
+        }
+    }
+    return code;
+}
+
+template<int CodeLimbs>
+uint16_t Syndrome(const HammingCode& code, const uint64_t (&bits)[CodeLimbs]) {
+    uint16_t syndrome = 0;
+    for (uint8_t byte = 0; byte < code.code_bytes; byte++) {
+        syndrome ^= code.parity_table[byte][(uint8_t) (bits[byte / 8] >> (56 - CHAR_BIT * (byte % 8)))];
+    }
+    return syndrome;
+}
+
+// Pieces are passed separately to let hot loops keep their copy on stack
+template<int DataLimbs, int CodeLimbs>
+void EncodeCodeword(const HammingCode& code, const HammingCode::Piece* pieces, uint8_t pieces_count,
+                    const uint64_t (&data)[DataLimbs], uint64_t (&bits)[CodeLimbs]) {
+    // Placing data bits between control bits
+    for (uint8_t i = 0; i < pieces_count; i++) {
+        const auto& piece = pieces[i];
+        bits[piece.code_limb] |= ((data[piece.data_limb] & piece.mask) >> piece.right) << piece.left;
+    }
+
+    // Control bits are zeros yet, so syndrome of codeword is exactly the control bits
+    uint16_t control = Syndrome(code, bits);
+    bits[0] |= code.control_bits[control & 127];
+    if constexpr (CodeLimbs > 1) bits[1] |= (control >> 7) & 1;
+    if constexpr (CodeLimbs > 3) bits[3] |= (control >> 8) & 1;
+}
+
+template<int DataLimbs, int CodeLimbs>
+void DecodeCodeword(const HammingCode& code, const HammingCode::Piece* pieces, uint8_t pieces_count,
+                    const uint64_t (&bits)[CodeLimbs], uint64_t (&data)[DataLimbs]) {
+    // Gathering data bits from between control bits
+    for (uint8_t i = 0; i < pieces_count; i++) {
+        const auto& piece = pieces[i];
+        data[piece.data_limb] |= ((bits[piece.code_limb] >> piece.left) << piece.right) & piece.mask;
+    }
+
+    // Nonzero syndrome is position of the wrong bit
+    uint16_t syndrome = Syndrome(code, bits);
+    for (int i = 0; i < DataLimbs; i++) {
+        data[i] ^= code.corrections[i][syndrome];
+    }
+}
+
+// Cursors and pieces are local, so stores to out can not change them and they stay in registers
+template<int DataLimbs, int CodeLimbs>
+void EncodeCodewordsImpl(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t count, uint8_t* out) {
+    BitCursor input(in, in_size);
+    BitPacker output(out);
+    HammingCode::Piece pieces[MAX_CODE_PIECES];
+    const uint8_t pieces_count = code.pieces_count;
+    std::copy(code.pieces, code.pieces + pieces_count, pieces);
+    const unsigned last_data_bits = code.word - 64 * (DataLimbs - 1);
+    const unsigned last_code_bits = code.length - 64 * (CodeLimbs - 1);
+    for (uint64_t codeword = 0; codeword < count; codeword++) {
+        uint64_t data[DataLimbs];
+        uint64_t bits[CodeLimbs] = {};
+        for (int i = 0; i < DataLimbs; i++) {
+            data[i] = input.Get(i == DataLimbs - 1 ? last_data_bits : 64);
+        }
+        EncodeCodeword(code, pieces, pieces_count, data, bits);
+        for (int i = 0; i < CodeLimbs; i++) {
+            output.Put(bits[i], i == CodeLimbs - 1 ? last_code_bits : 64);
+        }
+    }
+    output.Flush();
+}
+
+template<int DataLimbs, int CodeLimbs>
+void DecodeCodewordsImpl(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t count, uint8_t* out) {
+    BitCursor input(in, in_size);
+    BitPacker output(out);
+    HammingCode::Piece pieces[MAX_CODE_PIECES];
+    const uint8_t pieces_count = code.pieces_count;
+    std::copy(code.pieces, code.pieces + pieces_count, pieces);
+    const unsigned last_data_bits = code.word - 64 * (DataLimbs - 1);
+    const unsigned last_code_bits = code.length - 64 * (CodeLimbs - 1);
+    for (uint64_t codeword = 0; codeword < count; codeword++) {
+        uint64_t bits[CodeLimbs];
+        uint64_t data[DataLimbs] = {};
+        for (int i = 0; i < CodeLimbs; i++) {
+            bits[i] = input.Get(i == CodeLimbs - 1 ? last_code_bits : 64);
+        }
+        DecodeCodeword(code, pieces, pieces_count, bits, data);
+        for (int i = 0; i < DataLimbs; i++) {
+            output.Put(data[i], i == DataLimbs - 1 ? last_data_bits : 64);
+        }
+    }
+    output.Flush();
+}
+
+// Short codes use one lookup per codeword instead of pieces and syndrome
+void TranslateShortCodewords(const std::vector<uint16_t>& table, unsigned from_bits, unsigned to_bits,
+                             const uint8_t* in, size_t in_size, uint64_t count, uint8_t* out) {
+    BitCursor input(in, in_size);
+    BitPacker output(out);
+    const uint16_t* lookup = table.data();
+    for (uint64_t codeword = 0; codeword < count; codeword++) {
+        uint16_t value = lookup[input.GetShort(from_bits) >> (64 - from_bits)];
+        output.Put((uint64_t) value << (64 - to_bits), to_bits);
+    }
+    output.Flush();
+}
+
+void BuildShortTables(HammingCode& code) {
+    code.short_encode.resize(1u << code.word);
+    for (uint32_t value = 0; value < code.short_encode.size(); value++) {
+        uint64_t data[1] = {(uint64_t) value << (64 - code.word)};
+        uint64_t bits[1] = {};
+        EncodeCodeword(code, code.pieces, code.pieces_count, data, bits);
+        code.short_encode[value] = bits[0] >> (64 - code.length);
+    }
+    code.short_decode.resize(1u << code.length);
+    for (uint32_t value = 0; value < code.short_decode.size(); value++) {
+        uint64_t bits[1] = {(uint64_t) value << (64 - code.length)};
+        uint64_t data[1] = {};
+        DecodeCodeword(code, code.pieces, code.pieces_count, bits, data);
+        code.short_decode[value] = data[0] >> (64 - code.word);
+    }
+}
+
+// Syndromes of aligned profile are positions of plain Hamming code of its data bits, but only data bytes are folded
+HammingCode BuildAlignedCode(uint8_t word) {
+    HammingCode code = BuildHammingCode(word);
+    code.aligned = true;
+    code.extra_bits++;
+    code.length++;
+    code.code_limbs = (code.length + 63) / 64;
+    code.code_bytes = (code.length + CHAR_BIT - 1) / CHAR_BIT;
+    code.pieces_count = 0;
+    std::memset(code.parity_table, 0, sizeof(code.parity_table));
+    uint32_t data_pos = 0;
+    for (uint32_t pos = 1; data_pos < word; pos++) {
+        if ((pos & (pos - 1)) == 0) continue;
+        for (uint32_t value = 0; value < 256; value++) {
+            if (value & (0x80 >> data_pos % CHAR_BIT)) code.parity_table[data_pos / CHAR_BIT][value] ^= pos;
+        }
+        data_pos++;
+    }
+    for (uint32_t byte = 0; byte < word / CHAR_BIT; byte++) {
+        for (uint32_t value = 0; value < 256; value++) {
+            code.parity_table[byte][value] |= (__builtin_parity(value) << ALIGNED_PARITY_BIT);
+        }
+    }
+    return code;
+}
+
+template<unsigned DataBytes>
+uint16_t FoldAligned(const HammingCode& code, const uint8_t* data) {
+    uint16_t folded = 0;
+    for (unsigned byte = 0; byte < DataBytes; byte++) {
+        folded ^= code.parity_table[byte][data[byte]];
+    }
+    return folded;
+}
+
+// Wrong bit of aligned codeword by its data and check field: index of data bit or code.word + index of bit
+// of check field, -1 for correct codeword and -2 for uncorrectable one
+template<unsigned DataBytes>
+int32_t AlignedWrongBit(const HammingCode& code, const uint8_t* data, uint16_t field) {
+    uint16_t folded = FoldAligned<DataBytes>(code, data);
+    uint32_t syndrome = (folded ^ (field >> 1)) & ((1u << (code.extra_bits - 1)) - 1);
+    // Parity of the whole codeword is even, two wrong bits keep it
+    bool odd = ((folded >> ALIGNED_PARITY_BIT) ^ __builtin_parity(field)) & 1;
+    if (!odd) return syndrome ? -2 : -1;
+    if (syndrome == 0) return code.word + code.extra_bits - 1;
+    if ((syndrome & (syndrome - 1)) == 0) return code.word + code.extra_bits - 2 - __builtin_ctz(syndrome);
+    for (unsigned limb = 0; limb < DataBytes / sizeof(uint64_t); limb++) {
+        if (code.corrections[limb][syndrome]) return limb * 64 + __builtin_clzll(code.corrections[limb][syndrome]);
+    }
+    return -2;
+}
+
+// Data of group is copied as is and only check fields are computed, the last group may be incomplete
+template<unsigned DataBytes>
+void EncodeAlignedCodewords(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t count,
+                            uint8_t* out) {
+    const unsigned field_bits = code.extra_bits;
+    const uint32_t control_mask = (1u << (field_bits - 1)) - 1;
+    uint8_t padded[CHAR_BIT * DataBytes];
+    while (count) {
+        auto codewords = (unsigned) std::min<uint64_t>(count, CHAR_BIT);
+        size_t data_size = codewords * DataBytes;
+        const uint8_t* data = in;
+        if (in_size < data_size) {
+            std::memset(padded, 0, data_size);
+            std::memcpy(padded, in, in_size);
+            data = padded;
+        }
+        std::memcpy(out, data, data_size);
+        BitPacker fields(out + data_size);
+        for (unsigned i = 0; i < codewords; i++) {
+            uint16_t folded = FoldAligned<DataBytes>(code, data + i * DataBytes);
+            uint32_t control = folded & control_mask;
+            uint64_t field = (control << 1) | (((folded >> ALIGNED_PARITY_BIT) ^ __builtin_parity(control)) & 1);
+            fields.Put(field << (64 - field_bits), field_bits);
+        }
+        fields.Flush();
+        in += data_size;
+        in_size -= std::min(in_size, data_size);
+        out += data_size + (codewords * field_bits + CHAR_BIT - 1) / CHAR_BIT;
+        count -= codewords;
+    }
+}
+
+template<unsigned DataBytes>
+void DecodeAlignedCodewords(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t count,
+                            uint8_t* out) {
+    const unsigned field_bits = code.extra_bits;
+    while (count) {
+        auto codewords = (unsigned) std::min<uint64_t>(count, CHAR_BIT);
+        size_t data_size = codewords * DataBytes;
+        size_t group_size = data_size + (codewords * field_bits + CHAR_BIT - 1) / CHAR_BIT;
+        std::memcpy(out, in, data_size);
+        // Cursor reaches bytes after the group, so it reads whole 64-bit words
+        BitCursor fields(in + data_size, in_size - data_size);
+        for (unsigned i = 0; i < codewords; i++) {
+            auto field = (uint16_t) (fields.GetShort(field_bits) >> (64 - field_bits));
+            int32_t wrong = AlignedWrongBit<DataBytes>(code, out + i * DataBytes, field);
+            if (wrong >= 0 && wrong < code.word) out[i * DataBytes + wrong / CHAR_BIT] ^= 0x80 >> wrong % CHAR_BIT;
+        }
+        in += group_size;
+        in_size -= group_size;
+        out += data_size;
+        count -= codewords;
+    }
+}
+
+template<unsigned DataBytes>
+void CheckAlignedCodewords(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t count,
+                           CodewordErrors& errors, std::vector<uint64_t>* wrong_bits) {
+    const unsigned field_bits = code.extra_bits;
+    uint64_t bit_offset = 0;
+    while (count) {
+        auto codewords = (unsigned) std::min<uint64_t>(count, CHAR_BIT);
+        size_t data_size = codewords * DataBytes;
+        size_t group_size = data_size + (codewords * field_bits + CHAR_BIT - 1) / CHAR_BIT;
+        BitCursor fields(in + data_size, in_size - data_size);
+        for (unsigned i = 0; i < codewords; i++) {
+            auto field = (uint16_t) (fields.GetShort(field_bits) >> (64 - field_bits));
+            int32_t wrong = AlignedWrongBit<DataBytes>(code, in + i * DataBytes, field);
+            if (wrong == -1) continue;
+            if (wrong == -2) {
+                errors.uncorrectable++;
+                continue;
+            }
+            errors.corrected++;
+            if (!wrong_bits) continue;
+            // Check fields follow data of all codewords of group
+            wrong_bits->push_back(bit_offset + (wrong < code.word ? i * code.word + wrong
+                                                                  : codewords * code.word + i * field_bits +
+                                                                    wrong - code.word));
+        }
+        in += group_size;
+        in_size -= group_size;
+        bit_offset += group_size * CHAR_BIT;
+        count -= codewords;
+    }
+}
+
+CodecKernel DetectCodecKernel() {
+    if (CodecKernelSupported(CodecKernel::Avx512)) return CodecKernel::Avx512;
+    if (CodecKernelSupported(CodecKernel::Avx2)) return CodecKernel::Avx2;
+    return CodecKernel::Scalar;
+}
+
+CodecKernel codec_kernel = DetectCodecKernel();
+
+} // namespace
+
+bool VectorKernelSupports(uint8_t word) {
+    // Short codes (4, 11) are faster with whole lookup tables than with gathers
+    return word == 26 || word == 57 || word == 120;
+}
+
+CodecKernel GetCodecKernel() {
+    return codec_kernel;
+}
+
+void SetCodecKernel(CodecKernel kernel) {
+    if (!CodecKernelSupported(kernel))
+        throw std::runtime_error(std::string("Codec kernel ") + CodecKernelName(kernel) + " is not supported by CPU");
+    codec_kernel = kernel;
+}
+
+bool CodecKernelSupported(CodecKernel kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+    switch (kernel) {
+        case CodecKernel::Avx2:
+            return __builtin_cpu_supports("avx2");
+        case CodecKernel::Avx512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+        default:
+            return true;
+    }
+#else
+    return kernel == CodecKernel::Scalar;
+#endif
+}
+
+const char* CodecKernelName(CodecKernel kernel) {
+    switch (kernel) {
+        case CodecKernel::Avx2:
+            return "avx2";
+        case CodecKernel::Avx512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
+
+const HammingCode& GetHammingCode(uint16_t word) {
+    // Plain codes by word length and aligned profiles after them
+    static std::unique_ptr<HammingCode> codes[2 * (UINT8_MAX + 1)];
+    static std::once_flag flags[2 * (UINT8_MAX + 1)];
+    if (!IsValidWord(word)) throw std::logic_error("Word length must be in range 1 ... 255 or aligned profile");
+    std::call_once(flags[word], [word] {
+        if (word & ALIGNED_PROFILE_FLAG) {
+            codes[word] = std::make_unique<HammingCode>(BuildAlignedCode(GroupDataBytes(word)));
+            return;
+        }
+        codes[word] = std::make_unique<HammingCode>(BuildHammingCode(word));
+        if (codes[word]->length <= SHORT_CODE_LENGTH) BuildShortTables(*codes[word]);
+    });
+    return *codes[word];
+}
+
+uint64_t SliceBegin(uint16_t word, BlockLayout layout) {
+    if (layout == BlockLayout::Packed) return UINT64_MAX;
+    if (word & ALIGNED_PROFILE_FLAG) throw std::logic_error("Codewords of aligned profiles can't be interleaved");
+    uint64_t prefix_groups = (INTERLEAVED_PREFIX_SIZE + word - 1) / word;
+    return (prefix_groups + SLICE_GROUPS - 1) / SLICE_GROUPS * SLICE_GROUPS;
+}
+
+void CheckWordLayout(uint16_t word, BlockLayout layout) {
+    if (!IsValidWord(word)) throw std::logic_error("Word length must be in range 1 ... 255 or aligned profile");
+    if ((word & ALIGNED_PROFILE_FLAG) && layout != BlockLayout::Packed)
+        throw std::logic_error("Codewords of aligned profiles can't be interleaved");
+}
+
+namespace {
+
+// Every word bytes are 8 whole codewords of length bits, so only the last incomplete group needs rounding
+uint64_t CodedBytes(uint64_t word, uint64_t length, uint64_t data_bytes) {
+    uint64_t remaining_words = (CHAR_BIT * (data_bytes % word) + word - 1) / word;
+    return data_bytes / word * length + (remaining_words * length + CHAR_BIT - 1) / CHAR_BIT;
+}
+
+} // namespace
+
+uint64_t EncodedSize(uint16_t word, uint64_t data_bytes) {
+    return CodedBytes(GroupDataBytes(word), CodewordLength(word), data_bytes);
+}
+
+void EncodeCodewords(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t codewords_count,
+                     uint8_t* out) {
+    if (code.aligned) {
+        if (code.word == 64) EncodeAlignedCodewords<8>(code, in, in_size, codewords_count, out);
+        else EncodeAlignedCodewords<16>(code, in, in_size, codewords_count, out);
+        return;
+    }
+    // Whole groups by vector kernel, the rest (and the end of input) by scalar code
+    if (codewords_count >= CHAR_BIT && codec_kernel != CodecKernel::Scalar && VectorKernelSupports(code.word)) {
+        uint64_t groups = codewords_count / CHAR_BIT;
+        groups = codec_kernel == CodecKernel::Avx512 ? EncodeGroupsAvx512(code, in, in_size, groups, out)
+                                                     : EncodeGroupsAvx2(code, in, in_size, groups, out);
+        in += groups * code.word;
+        in_size -= groups * code.word;
+        out += groups * code.length;
+        codewords_count -= groups * CHAR_BIT;
+    }
+    if (!code.short_encode.empty()) {
+        TranslateShortCodewords(code.short_encode, code.word, code.length, in, in_size, codewords_count, out);
+        return;
+    }
+    switch (code.data_limbs * 8 + code.code_limbs) {
+        case 1 * 8 + 1:
+            EncodeCodewordsImpl<1, 1>(code, in, in_size, codewords_count, out);
+            break;
+        case 1 * 8 + 2:
+            EncodeCodewordsImpl<1, 2>(code, in, in_size, codewords_count, out);
+            break;
+        case 2 * 8 + 2:
+            EncodeCodewordsImpl<2, 2>(code, in, in_size, codewords_count, out);
+            break;
+        case 2 * 8 + 3:
+            EncodeCodewordsImpl<2, 3>(code, in, in_size, codewords_count, out);
+            break;
+        case 3 * 8 + 3:
+            EncodeCodewordsImpl<3, 3>(code, in, in_size, codewords_count, out);
+            break;
+        case 3 * 8 + 4:
+            EncodeCodewordsImpl<3, 4>(code, in, in_size, codewords_count, out);
+            break;
+        case 4 * 8 + 4:
+            EncodeCodewordsImpl<4, 4>(code, in, in_size, codewords_count, out);
+            break;
+        default:
+            EncodeCodewordsImpl<4, 5>(code, in, in_size, codewords_count, out);
+    }
+}
+
+void DecodeCodewords(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t codewords_count,
+                     uint8_t* out) {
+    if (code.aligned) {
+        if (code.word == 64) DecodeAlignedCodewords<8>(code, in, in_size, codewords_count, out);
+        else DecodeAlignedCodewords<16>(code, in, in_size, codewords_count, out);
+        return;
+    }
+    // Whole groups by vector kernel, the rest (and the end of input) by scalar code
+    if (codewords_count >= CHAR_BIT && codec_kernel != CodecKernel::Scalar && VectorKernelSupports(code.word)) {
+        uint64_t groups = codewords_count / CHAR_BIT;
+        groups = codec_kernel == CodecKernel::Avx512 ? DecodeGroupsAvx512(code, in, in_size, groups, out)
+                                                     : DecodeGroupsAvx2(code, in, in_size, groups, out);
+        in += groups * code.length;
+        in_size -= groups * code.length;
+        out += groups * code.word;
+        codewords_count -= groups * CHAR_BIT;
+    }
+    if (!code.short_decode.empty()) {
+        TranslateShortCodewords(code.short_decode, code.length, code.word, in, in_size, codewords_count, out);
+        return;
+    }
+    switch (code.data_limbs * 8 + code.code_limbs) {
+        case 1 * 8 + 1:
+            DecodeCodewordsImpl<1, 1>(code, in, in_size, codewords_count, out);
+            break;
+        case 1 * 8 + 2:
+            DecodeCodewordsImpl<1, 2>(code, in, in_size, codewords_count, out);
+            break;
+        case 2 * 8 + 2:
+            DecodeCodewordsImpl<2, 2>(code, in, in_size, codewords_count, out);
+            break;
+        case 2 * 8 + 3:
+            DecodeCodewordsImpl<2, 3>(code, in, in_size, codewords_count, out);
+            break;
+        case 3 * 8 + 3:
+            DecodeCodewordsImpl<3, 3>(code, in, in_size, codewords_count, out);
+            break;
+        case 3 * 8 + 4:
+            DecodeCodewordsImpl<3, 4>(code, in, in_size, codewords_count, out);
+            break;
+        case 4 * 8 + 4:
+            DecodeCodewordsImpl<4, 4>(code, in, in_size, codewords_count, out);
+            break;
+        default:
+            DecodeCodewordsImpl<4, 5>(code, in, in_size, codewords_count, out);
+    }
+}
+
+namespace {
+
+// Codeword is wrong if it differs from the coded result of its decoding, only wrong ones get syndrome
+void CheckShortCodewords(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t count,
+                         CodewordErrors& errors, std::vector<uint64_t>* wrong_bits) {
+    BitCursor input(in, in_size);
+    const uint16_t* encode = code.short_encode.data();
+    const uint16_t* decode = code.short_decode.data();
+    for (uint64_t codeword = 0; codeword < count; codeword++) {
+        uint64_t bits[1] = {input.GetShort(code.length)};
+        uint16_t value = bits[0] >> (64 - code.length);
+        if (encode[decode[value]] == value) continue;
+        uint16_t syndrome = Syndrome(code, bits);
+        if (syndrome > code.length) {
+            errors.uncorrectable++;
+            continue;
+        }
+        errors.corrected++;
+        if (wrong_bits) wrong_bits->push_back(codeword * code.length + syndrome - 1);
+    }
+}
+
+template<int CodeLimbs>
+void CheckCodewordsImpl(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t count,
+                        CodewordErrors& errors, std::vector<uint64_t>* wrong_bits) {
+    BitCursor input(in, in_size);
+    const unsigned last_code_bits = code.length - 64 * (CodeLimbs - 1);
+    for (uint64_t codeword = 0; codeword < count; codeword++) {
+        uint64_t bits[CodeLimbs];
+        for (int i = 0; i < CodeLimbs; i++) {
+            bits[i] = input.Get(i == CodeLimbs - 1 ? last_code_bits : 64);
+        }
+        uint16_t syndrome = Syndrome(code, bits);
+        if (syndrome == 0) continue;
+        if (syndrome > code.length) {
+            errors.uncorrectable++;
+            continue;
+        }
+        errors.corrected++;
+        if (wrong_bits) wrong_bits->push_back(codeword * code.length + syndrome - 1);
+    }
+}
+
+} // namespace
+
+void CheckCodewords(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t codewords_count,
+                    CodewordErrors& errors, std::vector<uint64_t>* wrong_bits) {
+    if (code.aligned) {
+        if (code.word == 64) CheckAlignedCodewords<8>(code, in, in_size, codewords_count, errors, wrong_bits);
+        else CheckAlignedCodewords<16>(code, in, in_size, codewords_count, errors, wrong_bits);
+        return;
+    }
+    uint64_t scalar_offset = 0;
+    if (codewords_count >= CHAR_BIT && codec_kernel != CodecKernel::Scalar && VectorKernelSupports(code.word)) {
+        uint64_t groups = codewords_count / CHAR_BIT;
+        groups = codec_kernel == CodecKernel::Avx512 ? CheckGroupsAvx512(code, in, in_size, groups, errors, wrong_bits)
+                                                     : CheckGroupsAvx2(code, in, in_size, groups, errors, wrong_bits);
+        in += groups * code.length;
+        in_size -= groups * code.length;
+        codewords_count -= groups * CHAR_BIT;
+        scalar_offset = groups * code.length * CHAR_BIT;
+    }
+    // Positions found by scalar code are counted from the rest of codewords
+    size_t first_scalar = wrong_bits ? wrong_bits->size() : 0;
+    if (!code.short_decode.empty()) {
+        CheckShortCodewords(code, in, in_size, codewords_count, errors, wrong_bits);
+    } else {
+        switch (code.code_limbs) {
+            case 1:
+                CheckCodewordsImpl<1>(code, in, in_size, codewords_count, errors, wrong_bits);
+                break;
+            case 2:
+                CheckCodewordsImpl<2>(code, in, in_size, codewords_count, errors, wrong_bits);
+                break;
+            case 3:
+                CheckCodewordsImpl<3>(code, in, in_size, codewords_count, errors, wrong_bits);
+                break;
+            case 4:
+                CheckCodewordsImpl<4>(code, in, in_size, codewords_count, errors, wrong_bits);
+                break;
+            default:
+                CheckCodewordsImpl<5>(code, in, in_size, codewords_count, errors, wrong_bits);
+        }
+    }
+    if (wrong_bits) {
+        for (size_t i = first_scalar; i < wrong_bits->size(); i++) {
+            (*wrong_bits)[i] += scalar_offset;
+        }
+    }
+}
+
+namespace {
+
+// Transposes 64x64 bit matrix in place: bit j (from the most significant) of row i becomes bit i of row j
+void TransposeBits(uint64_t* rows) {
+    uint64_t mask = 0x00000000FFFFFFFFull;
+    for (unsigned width = 32; width != 0; width >>= 1, mask ^= mask << width) {
+        for (unsigned i = 0; i < 64; i = (i + width + 1) & ~width) {
+            uint64_t swapped = (rows[i] ^ (rows[i + width] >> width)) & mask;
+            rows[i] ^= swapped;
+            rows[i + width] ^= swapped << width;
+        }
+    }
+}
+
+// Data of 64 codewords as planes: data[j] is data bit j of all codewords (limbs of codewords transposed)
+void LoadDataPlanes(const HammingCode& code, const uint8_t* in, uint64_t (&data)[MAX_DATA_LIMBS * 64]) {
+    BitCursor input(in, SLICE_GROUPS * code.word);
+    if (code.word <= 56) {
+        for (unsigned i = 0; i < 64; i++) {
+            data[i] = input.GetShort(code.word);
+        }
+        TransposeBits(data);
+        return;
+    }
+    for (unsigned i = 0; i < 64; i++) {
+        for (unsigned limb = 0; limb < code.data_limbs; limb++) {
+            data[limb * 64 + i] = input.Get(std::min(64u, code.word - 64u * limb));
+        }
+    }
+    for (unsigned limb = 0; limb < code.data_limbs; limb++) {
+        TransposeBits(data + limb * 64);
+    }
+}
+
+void StoreDataPlanes(const HammingCode& code, uint64_t (&data)[MAX_DATA_LIMBS * 64], uint8_t* out) {
+    for (unsigned limb = 0; limb < code.data_limbs; limb++) {
+        TransposeBits(data + limb * 64);
+    }
+    BitPacker output(out);
+    for (unsigned i = 0; i < 64; i++) {
+        for (unsigned limb = 0; limb < code.data_limbs; limb++) {
+            output.Put(data[limb * 64 + i], std::min(64u, code.word - 64u * limb));
+        }
+    }
+    output.Flush();
+}
+
+// Syndromes of 64 codewords by planes of their bits: bit b of syndrome of every codeword is XOR of positions
+// having bit b. Codewords with correctable syndromes get their wrong bit flipped, positions of flipped bits
+// are appended to wrong_bits from bit_offset
+void CorrectPlanes(const HammingCode& code, uint64_t* planes, CodewordErrors* errors,
+                   std::vector<uint64_t>* wrong_bits, uint64_t bit_offset) {
+    uint64_t syndromes[MAX_EXTRA_BITS] = {};
+    for (uint32_t pos = 1; pos <= code.length; pos++) {
+        for (uint32_t bits = pos; bits; bits &= bits - 1) {
+            syndromes[__builtin_ctz(bits)] ^= planes[pos - 1];
+        }
+    }
+    uint64_t dirty = 0;
+    for (uint8_t bit = 0; bit < code.extra_bits; bit++) {
+        dirty |= syndromes[bit];
+    }
+    while (dirty) {
+        unsigned codeword = __builtin_clzll(dirty);
+        uint64_t codeword_bit = LimbBit(codeword);
+        dirty ^= codeword_bit;
+        uint32_t syndrome = 0;
+        for (uint8_t bit = 0; bit < code.extra_bits; bit++) {
+            if (syndromes[bit] & codeword_bit) syndrome |= 1u << bit;
+        }
+        if (syndrome > code.length) {
+            if (errors) errors->uncorrectable++;
+            continue;
+        }
+        planes[syndrome - 1] ^= codeword_bit;
+        if (errors) errors->corrected++;
+        if (wrong_bits) wrong_bits->push_back(bit_offset + (syndrome - 1) * 64 + codeword);
+    }
+}
+
+void LoadPlanes(const HammingCode& code, const uint8_t* in, uint64_t* planes) {
+    for (uint32_t pos = 0; pos < code.length; pos++) {
+        planes[pos] = LoadBigEndian(in + pos * sizeof(uint64_t));
+    }
+}
+
+} // namespace
+
+void EncodeSlices(const HammingCode& code, const uint8_t* in, uint64_t slices, uint8_t* out) {
+    uint64_t data[MAX_DATA_LIMBS * 64];
+    for (uint64_t slice = 0; slice < slices; slice++) {
+        LoadDataPlanes(code, in, data);
+        // Data planes go to their positions, control planes are XOR of positions they check
+        uint64_t control[MAX_EXTRA_BITS] = {};
+        uint32_t data_pos = 0;
+        for (uint32_t pos = 1; pos <= code.length; pos++) {
+            if ((pos & (pos - 1)) == 0) continue;
+            uint64_t plane = data[data_pos++];
+            for (uint32_t bits = pos; bits; bits &= bits - 1) {
+                control[__builtin_ctz(bits)] ^= plane;
+            }
+            StoreBigEndian(out + (pos - 1) * sizeof(uint64_t), plane);
+        }
+        for (uint8_t bit = 0; bit < code.extra_bits; bit++) {
+            StoreBigEndian(out + ((1u << bit) - 1) * sizeof(uint64_t), control[bit]);
+        }
+        in += SLICE_GROUPS * code.word;
+        out += SLICE_GROUPS * code.length;
+    }
+}
+
+void DecodeSlices(const HammingCode& code, const uint8_t* in, uint64_t slices, uint8_t* out) {
+    uint64_t planes[MAX_CODE_LIMBS * 64];
+    uint64_t data[MAX_DATA_LIMBS * 64] = {};
+    for (uint64_t slice = 0; slice < slices; slice++) {
+        LoadPlanes(code, in, planes);
+        CorrectPlanes(code, planes, nullptr, nullptr, 0);
+        uint32_t data_pos = 0;
+        for (uint32_t pos = 1; pos <= code.length; pos++) {
+            if ((pos & (pos - 1)) == 0) continue;
+            data[data_pos++] = planes[pos - 1];
+        }
+        std::fill(data + data_pos, data + code.data_limbs * 64, 0);
+        StoreDataPlanes(code, data, out);
+        in += SLICE_GROUPS * code.length;
+        out += SLICE_GROUPS * code.word;
+    }
+}
+
+void CheckSlices(const HammingCode& code, const uint8_t* in, uint64_t slices, CodewordErrors& errors,
+                 std::vector<uint64_t>* wrong_bits) {
+    uint64_t planes[MAX_CODE_LIMBS * 64];
+    for (uint64_t slice = 0; slice < slices; slice++) {
+        LoadPlanes(code, in + slice * SLICE_GROUPS * code.length, planes);
+        CorrectPlanes(code, planes, &errors, wrong_bits, slice * SLICE_GROUPS * code.length * CHAR_BIT);
+    }
+}
+
+void CheckBlockCodewords(const HammingCode& code, const uint8_t* in, uint64_t data_bytes, uint64_t first_group,
+                         uint64_t slice_begin, CodewordErrors& errors, std::vector<uint64_t>* wrong_bits) {
+    uint64_t group = first_group;
+    uint64_t coded_offset = 0;
+    while (data_bytes) {
+        // Runs of packed groups and of slices, positions of wrong bits are counted from the beginning of part
+        size_t first_wrong_bit = wrong_bits ? wrong_bits->size() : 0;
+        uint64_t run_bytes;
+        if (group >= slice_begin && data_bytes >= SLICE_GROUPS * code.word) {
+            uint64_t slices = data_bytes / (SLICE_GROUPS * code.word);
+            CheckSlices(code, in + coded_offset, slices, errors, wrong_bits);
+            run_bytes = slices * SLICE_GROUPS * code.word;
+        } else {
+            run_bytes = group < slice_begin ? std::min(data_bytes, (slice_begin - group) * code.word) : data_bytes;
+            uint64_t codewords = run_bytes / code.word * CHAR_BIT +
+                                 (CHAR_BIT * (run_bytes % code.word) + code.word - 1) / code.word;
+            CheckCodewords(code, in + coded_offset, CodedBytes(code.word, code.length, run_bytes), codewords,
+                           errors, wrong_bits);
+        }
+        if (wrong_bits) {
+            for (size_t i = first_wrong_bit; i < wrong_bits->size(); i++) {
+                (*wrong_bits)[i] += coded_offset * CHAR_BIT;
+            }
+        }
+        group += run_bytes / code.word;
+        coded_offset += CodedBytes(code.word, code.length, run_bytes);
+        data_bytes -= run_bytes;
+    }
+}
+
+HammingEncoder::HammingEncoder(uint16_t word, BlockLayout layout, uint64_t first_group)
+    : code_(GetHammingCode(word)),
+      slice_begin_(SliceBegin(word, layout)),
+      group_(first_group) {
+    carry_.reserve(layout == BlockLayout::Packed ? code_.word : SLICE_GROUPS * code_.word);
+}
+
+size_t HammingEncoder::Code(const uint8_t* data, uint64_t units, bool sliced, uint8_t* out) {
+    if (sliced) {
+        EncodeSlices(code_, data, units, out);
+        group_ += units * SLICE_GROUPS;
+        return units * SLICE_GROUPS * code_.length;
+    }
+    EncodeCodewords(code_, data, units * code_.word, units * CHAR_BIT, out);
+    group_ += units;
+    return units * code_.length;
+}
+
+size_t HammingEncoder::UpdateBound(size_t size) const {
+    // Only whole groups are coded
+    return (carry_.size() + size) / code_.word * code_.length;
+}
+
+size_t HammingEncoder::Update(const uint8_t* input, size_t size, uint8_t* out) {
+    size_t used = 0;
+    size_t written = 0;
+    while (used < size) {
+        // Packed groups before slices and whole slices after them
+        bool sliced = group_ >= slice_begin_;
+        size_t unit = sliced ? SLICE_GROUPS * code_.word : code_.word;
+
+        // Completing unit started in previous call
+        if (!carry_.empty()) {
+            size_t taken = std::min(size - used, unit - carry_.size());
+            carry_.insert(carry_.end(), input + used, input + used + taken);
+            used += taken;
+            if (carry_.size() < unit) return written;
+            written += Code(carry_.data(), 1, sliced, out + written);
+            carry_.clear();
+            continue;
+        }
+
+        uint64_t units = (size - used) / unit;
+        if (!sliced) units = std::min(units, slice_begin_ - group_);
+        if (units == 0) break;
+        written += Code(input + used, units, sliced, out + written);
+        used += units * unit;
+    }
+    carry_.insert(carry_.end(), input + used, input + size);
+    return written;
+}
+
+void HammingEncoder::Update(const char* data, size_t size, std::vector<char>& out) {
+    size_t old_size = out.size();
+    out.resize(old_size + UpdateBound(size));
+    size_t written = Update(reinterpret_cast<const uint8_t*>(data), size,
+                            reinterpret_cast<uint8_t*>(out.data() + old_size));
+    out.resize(old_size + written);
+}
+
+size_t HammingEncoder::Update(std::span<const std::byte> data, std::span<std::byte> out) {
+    if (out.size() < UpdateBound(data.size()))
+        throw std::length_error("Output of Hamming encoder is smaller than its bound");
+    return Update(reinterpret_cast<const uint8_t*>(data.data()), data.size(),
+                  reinterpret_cast<uint8_t*>(out.data()));
+}
+
+size_t HammingEncoder::FinishBound() const {
+    uint64_t codewords_count = (CHAR_BIT * carry_.size() + code_.word - 1) / code_.word;
+    return (codewords_count * code_.length + CHAR_BIT - 1) / CHAR_BIT;
+}
+
+size_t HammingEncoder::Finish(uint8_t* out) {
+    // Incomplete slice is packed as incomplete group
+    size_t written = FinishBound();
+    if (!carry_.empty()) {
+        uint64_t codewords_count = (CHAR_BIT * carry_.size() + code_.word - 1) / code_.word;
+        EncodeCodewords(code_, carry_.data(), carry_.size(), codewords_count, out);
+        carry_.clear();
+    }
+    group_ = 0;
+    return written;
+}
+
+void HammingEncoder::Finish(std::vector<char>& out) {
+    size_t old_size = out.size();
+    out.resize(old_size + FinishBound());
+    Finish(reinterpret_cast<uint8_t*>(out.data() + old_size));
+}
+
+size_t HammingEncoder::Finish(std::span<std::byte> out) {
+    if (out.size() < FinishBound())
+        throw std::length_error("Output of Hamming encoder is smaller than its bound");
+    return Finish(reinterpret_cast<uint8_t*>(out.data()));
+}
+
+HammingDecoder::HammingDecoder(uint16_t word, uint64_t data_bytes, BlockLayout layout)
+    : code_(GetHammingCode(word)),
+      remaining_(data_bytes),
+      slice_begin_(SliceBegin(word, layout)) {
+    carry_.reserve(layout == BlockLayout::Packed ? code_.length : SLICE_GROUPS * code_.length);
+}
+
+size_t HammingDecoder::UpdateBound(size_t size) const {
+    // Whole groups and the last incomplete one
+    return std::min<uint64_t>(remaining_, ((carry_.size() + size) / code_.length + 1) * code_.word);
+}
+
+std::pair<size_t, size_t> HammingDecoder::Update(const uint8_t* input, size_t size, uint8_t* out) {
+    size_t used = 0;
+    size_t written = 0;
+    while (remaining_ && used < size) {
+        // Whole slices after the packed prefix, packed groups before them and after the last whole slice
+        bool sliced = group_ >= slice_begin_ && remaining_ >= SLICE_GROUPS * code_.word;
+        uint64_t unit = sliced ? SLICE_GROUPS * code_.word : code_.word;
+        uint64_t unit_length = sliced ? SLICE_GROUPS * code_.length : code_.length;
+
+        // Whole units straight from input
+        if (carry_.empty() && remaining_ >= unit) {
+            uint64_t units = std::min<uint64_t>((size - used) / unit_length, remaining_ / unit);
+            if (!sliced && group_ < slice_begin_) units = std::min(units, slice_begin_ - group_);
+            if (units) {
+                if (sliced) DecodeSlices(code_, input + used, units, out + written);
+                else DecodeCodewords(code_, input + used, units * code_.length, units * CHAR_BIT, out + written);
+                used += units * unit_length;
+                written += units * unit;
+                remaining_ -= units * unit;
+                group_ += sliced ? units * SLICE_GROUPS : units;
+                continue;
+            }
+        }
+
+        // Unit split between calls or the last incomplete group
+        bool whole_unit = remaining_ >= unit;
+        size_t coded_unit = whole_unit ? unit_length : CodedBytes(code_.word, code_.length, remaining_);
+        size_t taken = std::min(coded_unit - carry_.size(), size - used);
+        carry_.insert(carry_.end(), input + used, input + used + taken);
+        used += taken;
+        if (carry_.size() < coded_unit) break;
+
+        uint64_t data_bytes = whole_unit ? unit : remaining_;
+        uint8_t decoded[SLICE_GROUPS * (MAX_DATA_LIMBS * 64 / CHAR_BIT) * CHAR_BIT];
+        if (sliced) {
+            DecodeSlices(code_, carry_.data(), 1, decoded);
+        } else {
+            uint64_t codewords_count = (CHAR_BIT * data_bytes + code_.word - 1) / code_.word;
+            DecodeCodewords(code_, carry_.data(), carry_.size(), codewords_count, decoded);
+        }
+        std::memcpy(out + written, decoded, data_bytes);
+        written += data_bytes;
+        remaining_ -= data_bytes;
+        group_ += sliced ? SLICE_GROUPS : 1;
+        carry_.clear();
+    }
+    return {used, written};
+}
+
+size_t HammingDecoder::Update(const char* data, size_t size, std::vector<char>& out) {
+    size_t old_size = out.size();
+    out.resize(old_size + UpdateBound(size));
+    auto [used, written] = Update(reinterpret_cast<const uint8_t*>(data), size,
+                                  reinterpret_cast<uint8_t*>(out.data() + old_size));
+    out.resize(old_size + written);
+    return used;
+}
+
+std::pair<size_t, size_t> HammingDecoder::Update(std::span<const std::byte> data, std::span<std::byte> out) {
+    if (out.size() < UpdateBound(data.size()))
+        throw std::length_error("Output of Hamming decoder is smaller than its bound");
+    return Update(reinterpret_cast<const uint8_t*>(data.data()), data.size(), reinterpret_cast<uint8_t*>(out.data()));
+}
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Longest codeword is 255 data bits + 9 control bits = 264 bits, so it takes five 64-bit limbs
+#define MAX_DATA_LIMBS 4
+#define MAX_CODE_LIMBS 5
+#define MAX_EXTRA_BITS 9
+#define MAX_CODE_PIECES 16
+// Codes up to this length are coded with whole lookup tables (default 11-bit word has 15-bit codewords)
+#define SHORT_CODE_LENGTH 16
+// Groups (8 codewords) in slice of interleaved layout, it is 64 codewords
+#define SLICE_GROUPS 8
+// Data bytes at the beginning of interleaved block which are always packed: header of included file is decoded
+// by prefix of block before its size is known, and the longest header is 1 + 255 + 8 bytes
+#define INTERLEAVED_PREFIX_SIZE 264
+// Word of byte-aligned profile is its data bits with this flag: SECDED codes (72,64) and (137,128)
+#define ALIGNED_PROFILE_FLAG 0x100
+#define SECDED_72_64 (ALIGNED_PROFILE_FLAG | 64)
+#define SECDED_137_128 (ALIGNED_PROFILE_FLAG | 128)
+// Bit of folded parity table of aligned profile which holds parity of data byte
+#define ALIGNED_PARITY_BIT 15
+
+/*
+ * Precomputed layout of the Hamming code for one word length.
+ * Bits are numbered as they go in the stream (most significant bit of every byte first),
+ * codeword position p (1-indexed) is stored in limb (p - 1) / 64 at bit 63 - (p - 1) % 64.
+ * Control bits take positions 1, 2, 4, 8, ..., data bits fill the rest in order,
+ * so data is moved to the codeword by a few masked shifts (pieces) instead of bit by bit.
+ */
+struct HammingCode {
+    struct Piece {
+        uint64_t mask;      // bits of the data limb that belong to this piece
+        uint8_t data_limb;
+        uint8_t code_limb;
+        uint8_t right;      // one of shifts is always zero
+        uint8_t left;
+    };
+
+    uint8_t word;
+    uint8_t extra_bits;
+    // Aligned profile (described below), the other fields are for plain Hamming code
+    bool aligned;
+    uint16_t length;
+    uint8_t data_limbs;
+    uint8_t code_limbs;
+    uint8_t code_bytes;
+    uint8_t pieces_count;
+    Piece pieces[MAX_CODE_PIECES];
+    // Parity masks folded by bytes: XOR of positions of set bits of every byte of codeword,
+    // so control bits (or syndrome) of codeword are XOR of code_bytes values
+    uint16_t parity_table[(MAX_CODE_LIMBS * 64) / 8][256];
+    // Control bits 1 ... 64 placed to their positions in the first limb
+    uint64_t control_bits[128];
+    // Data bit to flip for every syndrome by data limbs, zeros for errors in control bits and uncorrectable syndromes
+    uint64_t corrections[MAX_DATA_LIMBS][1 << MAX_EXTRA_BITS];
+    // Codeword positions checked by every control bit (vector kernels count parity of them instead of table lookups)
+    uint64_t parity_masks[MAX_EXTRA_BITS][MAX_CODE_LIMBS];
+    // Only for short codes: codeword by data and corrected data by codeword
+    std::vector<uint16_t> short_encode;
+    std::vector<uint16_t> short_decode;
+};
+
+/*
+ * Aligned profiles are extended Hamming codes (SECDED) of 64 and 128 data bits with the overall parity bit, so
+ * their codewords are 72 and 137 bits. Data is never shifted: group of 8 codewords (or less at the end of block)
+ * is their data as is and then their check fields of extra_bits bits: control bits and parity bit in the lowest
+ * one. Control bits are XOR of parity_table values of data bytes (parity of data is in ALIGNED_PARITY_BIT),
+ * corrections are the same as for data positions of plain Hamming code. Two wrong bits are uncorrectable
+ */
+
+uint8_t CountAddedBits(uint8_t word);
+
+// Word is word length 1 ... 255 or one of aligned profiles
+bool IsValidWord(uint16_t word);
+
+// Word by its name in command line: word length or aligned profile "72,64" or "137,128", throws for others
+uint16_t ParseWord(const std::string& name);
+
+// "11bit" or "(72,64) SECDED"
+std::string WordName(uint16_t word);
+
+// Data bytes of 8 codewords of word (word length or data bits of aligned profile)
+inline uint8_t GroupDataBytes(uint16_t word) {
+    return (uint8_t) word;
+}
+
+// Bits of codeword of word, 8 codewords are as many bytes
+uint16_t CodewordLength(uint16_t word);
+
+/*
+ * Layout of codewords in coded block, it is the same for all blocks of Haf.
+ * Interleaved block is split into slices of 64 codewords (8 groups) stored as code length 64-bit planes:
+ * plane p - 1 holds position p of all codewords, codeword i is bit i from the most significant. Slice is coded
+ * by XOR of whole planes, and burst of wrong bits inside one plane is one wrong bit of many codewords.
+ * Slices start from the first slice after INTERLEAVED_PREFIX_SIZE bytes of data, groups before them and after
+ * the last whole slice are packed, so coded size of block does not depend on layout
+ */
+enum class BlockLayout {
+    Packed,
+    Interleaved
+};
+
+// Index of group of block where slices start, UINT64_MAX for packed layout
+// (aligned profiles are never interleaved)
+uint64_t SliceBegin(uint16_t word, BlockLayout layout);
+
+// Throws if word is not valid or its codewords can't be laid out so, it is checked before output is opened
+void CheckWordLayout(uint16_t word, BlockLayout layout);
+
+// Implementations of EncodeCodewords/DecodeCodewords, vector ones code many codewords per instruction
+// for word lengths 26, 57 and 120 and fall back to scalar code for others
+enum class CodecKernel {
+    Scalar,
+    Avx2,
+    Avx512
+};
+
+// Kernel is chosen by CPUID at startup
+CodecKernel GetCodecKernel();
+
+// Throws if CPU does not support the kernel
+void SetCodecKernel(CodecKernel kernel);
+
+bool CodecKernelSupported(CodecKernel kernel);
+
+const char* CodecKernelName(CodecKernel kernel);
+
+// Tables are built once per word length and live until the end of the program
+const HammingCode& GetHammingCode(uint16_t word);
+
+// Size of data_bytes after coding: data is split into words, last word is padded with zeros, and
+// the codewords are padded with zeros up to the whole byte
+uint64_t EncodedSize(uint16_t word, uint64_t data_bytes);
+
+// Encodes codewords_count consecutive codewords from in to out, missing data bits are zeros.
+// out must hold (codewords_count * code.length + 7) / 8 bytes
+void EncodeCodewords(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t codewords_count,
+                     uint8_t* out);
+
+// Decodes codewords_count consecutive codewords from in to out correcting single bit errors.
+// out must hold (codewords_count * code.word + 7) / 8 bytes
+void DecodeCodewords(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t codewords_count,
+                     uint8_t* out);
+
+// Codes slices * 64 codewords by bit planes, in holds slices * SLICE_GROUPS * code.word bytes,
+// out gets slices * SLICE_GROUPS * code.length bytes
+void EncodeSlices(const HammingCode& code, const uint8_t* in, uint64_t slices, uint8_t* out);
+
+void DecodeSlices(const HammingCode& code, const uint8_t* in, uint64_t slices, uint8_t* out);
+
+// Codewords with nonzero syndrome: single bit errors are corrected, syndromes pointing outside of codeword are
+// uncorrectable. Two wrong bits may look as one, so these numbers are lower bounds
+struct CodewordErrors {
+    uint64_t corrected = 0;
+    uint64_t uncorrectable = 0;
+};
+
+// Counts errors of codewords_count consecutive codewords without decoding them. If wrong_bits is set,
+// positions of corrected bits (bit offsets from in) are appended to it
+void CheckCodewords(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t codewords_count,
+                    CodewordErrors& errors, std::vector<uint64_t>* wrong_bits = nullptr);
+
+void CheckSlices(const HammingCode& code, const uint8_t* in, uint64_t slices, CodewordErrors& errors,
+                 std::vector<uint64_t>* wrong_bits = nullptr);
+
+// Checks part of coded block with data_bytes of data starting from group first_group of block:
+// packed groups by CheckCodewords, slices (from group slice_begin) by CheckSlices
+void CheckBlockCodewords(const HammingCode& code, const uint8_t* in, uint64_t data_bytes, uint64_t first_group,
+                         uint64_t slice_begin, CodewordErrors& errors, std::vector<uint64_t>* wrong_bits = nullptr);
+
+/*
+ * Streaming encoder of one coded block (Haf header or included file).
+ * Every word bytes of data are exactly 8 codewords, which are exactly code.length bytes,
+ * so data is coded in such groups (or slices of interleaved layout) and only the incomplete one is kept between calls.
+ * Span versions write to memory of caller, which must hold the bound of call (they throw std::length_error otherwise)
+ * and return number of written bytes.
+ */
+class HammingEncoder {
+public:
+    // Interleaved block may be coded by chunks of whole slices, first_group is index of the first group of chunk
+    explicit HammingEncoder(uint16_t word, BlockLayout layout = BlockLayout::Packed, uint64_t first_group = 0);
+
+    // The most bytes written by Update of size bytes
+    size_t UpdateBound(size_t size) const;
+
+    size_t Update(std::span<const std::byte> data, std::span<std::byte> out);
+
+    // Appends coded data to out
+    void Update(const char* data, size_t size, std::vector<char>& out);
+
+    size_t FinishBound() const;
+
+    // Codes remaining data (padded with zeros) and starts new block
+    size_t Finish(std::span<std::byte> out);
+
+    void Finish(std::vector<char>& out);
+
+private:
+    // Codes units whole packed groups or slices
+    size_t Code(const uint8_t* data, uint64_t units, bool sliced, uint8_t* out);
+
+    size_t Update(const uint8_t* data, size_t size, uint8_t* out);
+
+    size_t Finish(uint8_t* out);
+
+    const HammingCode& code_;
+    uint64_t slice_begin_;
+    uint64_t group_;
+    std::vector<uint8_t> carry_;
+};
+
+/*
+ * Streaming decoder of one coded block with known size of original data.
+ * Groups of code.length coded bytes (and slices of interleaved layout) are decoded to word bytes,
+ * the last incomplete group is decoded when all of its bytes are received.
+ */
+class HammingDecoder {
+public:
+    HammingDecoder(uint16_t word, uint64_t data_bytes, BlockLayout layout = BlockLayout::Packed);
+
+    // The most bytes written by Update of size bytes
+    size_t UpdateBound(size_t size) const;
+
+    // Returns numbers of used bytes of data and written bytes of out
+    std::pair<size_t, size_t> Update(std::span<const std::byte> data, std::span<std::byte> out);
+
+    // Appends decoded data to out, returns number of used bytes (bytes after the end of block are not used)
+    size_t Update(const char* data, size_t size, std::vector<char>& out);
+
+    bool Finished() const {
+        return remaining_ == 0;
+    }
+
+private:
+    std::pair<size_t, size_t> Update(const uint8_t* data, size_t size, uint8_t* out);
+
+    const HammingCode& code_;
+    uint64_t remaining_;
+    uint64_t slice_begin_;
+    uint64_t group_ = 0;
+    std::vector<uint8_t> carry_;
+};
@@ -0,0 +1,87 @@
+#include "hamming_kernels.h"
+#include "bitpack.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC target("avx2")
+#endif
+
+#include "hamming_simd.h"
+
+namespace {
+
+struct Avx2 {
+    using V = __m256i;
+    static constexpr int kLanes = 4;
+
+    static V Zero() { return _mm256_setzero_si256(); }
+    static V Set1(uint64_t value) { return _mm256_set1_epi64x((long long) value); }
+    static V Load(const uint64_t* ptr) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)); }
+    static void Store(uint64_t* ptr, V value) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(ptr), value); }
+    static V Add(V a, V b) { return _mm256_add_epi64(a, b); }
+    static V And(V a, V b) { return _mm256_and_si256(a, b); }
+    static V Or(V a, V b) { return _mm256_or_si256(a, b); }
+    static V Xor(V a, V b) { return _mm256_xor_si256(a, b); }
+    static V Sll(V value, unsigned count) { return _mm256_sll_epi64(value, _mm_cvtsi32_si128((int) count)); }
+    static V Srl(V value, unsigned count) { return _mm256_srl_epi64(value, _mm_cvtsi32_si128((int) count)); }
+    static V Sllv(V value, V counts) { return _mm256_sllv_epi64(value, counts); }
+    static V Srlv(V value, V counts) { return _mm256_srlv_epi64(value, counts); }
+    static bool IsZero(V value) { return _mm256_testz_si256(value, value); }
+
+    static V Gather(const uint8_t* base, V offsets) {
+        return _mm256_i64gather_epi64(reinterpret_cast<const long long*>(base), offsets, 1);
+    }
+
+    static V GatherTable(const uint64_t* table, V indexes) {
+        return _mm256_i64gather_epi64(reinterpret_cast<const long long*>(table), indexes, 8);
+    }
+
+    static V Bswap(V value) {
+        const auto order = _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+                                           8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+        return _mm256_shuffle_epi8(value, order);
+    }
+};
+
+} // namespace
+
+uint64_t EncodeGroupsAvx2(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups, uint8_t* out) {
+    return EncodeGroupsVector<Avx2>(code, in, in_size, groups, out);
+}
+
+uint64_t DecodeGroupsAvx2(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups, uint8_t* out) {
+    return DecodeGroupsVector<Avx2>(code, in, in_size, groups, out);
+}
+
+uint64_t CheckGroupsAvx2(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups,
+                         CodewordErrors& errors, std::vector<uint64_t>* wrong_bits) {
+    return CheckGroupsVector<Avx2>(code, in, in_size, groups, errors, wrong_bits);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#else
+
+uint64_t EncodeGroupsAvx2(const HammingCode&, const uint8_t*, size_t, uint64_t, uint8_t*) {
+    return 0;
+}
+
+uint64_t DecodeGroupsAvx2(const HammingCode&, const uint8_t*, size_t, uint64_t, uint8_t*) {
+    return 0;
+}
+
+uint64_t CheckGroupsAvx2(const HammingCode&, const uint8_t*, size_t, uint64_t, CodewordErrors&,
+                         std::vector<uint64_t>*) {
+    return 0;
+}
+
+#endif
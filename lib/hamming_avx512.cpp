@@ -0,0 +1,87 @@
+#include "hamming_kernels.h"
+#include "bitpack.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f,avx512bw"))), apply_to = function)
+#else
+#pragma GCC target("avx512f,avx512bw")
+#endif
+
+#include "hamming_simd.h"
+
+namespace {
+
+struct Avx512 {
+    using V = __m512i;
+    static constexpr int kLanes = 8;
+
+    static V Zero() { return _mm512_setzero_si512(); }
+    static V Set1(uint64_t value) { return _mm512_set1_epi64((long long) value); }
+    static V Load(const uint64_t* ptr) { return _mm512_loadu_si512(ptr); }
+    static void Store(uint64_t* ptr, V value) { _mm512_storeu_si512(ptr, value); }
+    static V Add(V a, V b) { return _mm512_add_epi64(a, b); }
+    static V And(V a, V b) { return _mm512_and_si512(a, b); }
+    static V Or(V a, V b) { return _mm512_or_si512(a, b); }
+    static V Xor(V a, V b) { return _mm512_xor_si512(a, b); }
+    static V Sll(V value, unsigned count) { return _mm512_sll_epi64(value, _mm_cvtsi32_si128((int) count)); }
+    static V Srl(V value, unsigned count) { return _mm512_srl_epi64(value, _mm_cvtsi32_si128((int) count)); }
+    static V Sllv(V value, V counts) { return _mm512_sllv_epi64(value, counts); }
+    static V Srlv(V value, V counts) { return _mm512_srlv_epi64(value, counts); }
+    static bool IsZero(V value) { return _mm512_test_epi64_mask(value, value) == 0; }
+
+    static V Gather(const uint8_t* base, V offsets) {
+        return _mm512_i64gather_epi64(offsets, base, 1);
+    }
+
+    static V GatherTable(const uint64_t* table, V indexes) {
+        return _mm512_i64gather_epi64(indexes, table, 8);
+    }
+
+    static V Bswap(V value) {
+        const auto order = _mm512_set4_epi64(0x08090a0b0c0d0e0fll, 0x0001020304050607ll,
+                                             0x08090a0b0c0d0e0fll, 0x0001020304050607ll);
+        return _mm512_shuffle_epi8(value, order);
+    }
+};
+
+} // namespace
+
+uint64_t EncodeGroupsAvx512(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups, uint8_t* out) {
+    return EncodeGroupsVector<Avx512>(code, in, in_size, groups, out);
+}
+
+uint64_t DecodeGroupsAvx512(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups, uint8_t* out) {
+    return DecodeGroupsVector<Avx512>(code, in, in_size, groups, out);
+}
+
+uint64_t CheckGroupsAvx512(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups,
+                       CodewordErrors& errors, std::vector<uint64_t>* wrong_bits) {
+    return CheckGroupsVector<Avx512>(code, in, in_size, groups, errors, wrong_bits);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#else
+
+uint64_t EncodeGroupsAvx512(const HammingCode&, const uint8_t*, size_t, uint64_t, uint8_t*) {
+    return 0;
+}
+
+uint64_t DecodeGroupsAvx512(const HammingCode&, const uint8_t*, size_t, uint64_t, uint8_t*) {
+    return 0;
+}
+
+uint64_t CheckGroupsAvx512(const HammingCode&, const uint8_t*, size_t, uint64_t, CodewordErrors&,
+                       std::vector<uint64_t>*) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+// Entry points of vector kernels used by EncodeCodewords/DecodeCodewords (not a public interface)
+
+#include "hamming.h"
+
+// Word lengths with vector kernels: all codewords of them fit into one or two 64-bit lanes
+bool VectorKernelSupports(uint8_t word);
+
+// Kernels code whole groups (8 codewords), they stop before groups whose loads would cross the end of in
+// and return number of coded groups, the rest is coded by scalar code
+uint64_t EncodeGroupsAvx2(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups, uint8_t* out);
+
+uint64_t DecodeGroupsAvx2(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups, uint8_t* out);
+
+uint64_t CheckGroupsAvx2(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups,
+                         CodewordErrors& errors, std::vector<uint64_t>* wrong_bits);
+
+uint64_t EncodeGroupsAvx512(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups,
+                            uint8_t* out);
+
+uint64_t DecodeGroupsAvx512(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups,
+                            uint8_t* out);
+
+uint64_t CheckGroupsAvx512(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups,
+                           CodewordErrors& errors, std::vector<uint64_t>* wrong_bits);
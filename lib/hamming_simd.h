@@ -0,0 +1,280 @@
+#pragma once
+
+/*
+ * Multi-codeword Hamming kernels over vector operations Ops: one codeword in every 64-bit lane
+ * (or in the same lane of two vectors for codes longer than 64 bits).
+ * Included by hamming_avx2.cpp and hamming_avx512.cpp after their target pragma, so every function here
+ * is a template of Ops and gets the instruction set of the including file.
+ *
+ * Codewords of a group start at fixed bit offsets, so lanes are loaded by gathers with the same
+ * offsets for every group, data bits are moved by the pieces of HammingCode, control bits and syndromes
+ * are counted as parity of masked lanes (folded by shifts to the highest bit).
+ * Lanes are packed to the stream by the scalar BitPacker.
+ * Including files must include bitpack.h and <algorithm> before the pragma, so shared inline functions
+ * keep the default instruction set.
+ */
+
+#include "bitpack.h"
+#include "hamming.h"
+
+#include <algorithm>
+
+// Bits of limb i of value that has total_bits bits
+static inline unsigned LimbBits(unsigned total_bits, int limb) {
+    return std::min(64u, total_bits - 64 * limb);
+}
+
+// Parity of lane is moved to its highest bit, only highest width bits of lane may be nonzero
+template<class Ops>
+typename Ops::V FoldParity(typename Ops::V value, unsigned width) {
+    for (unsigned shift = 1; shift < width; shift *= 2) {
+        value = Ops::Xor(value, Ops::Sll(value, shift));
+    }
+    return value;
+}
+
+// Offsets of codewords of group: byte to load from and shift of the first bit in it
+template<class Ops, int Batches>
+struct GroupLayout {
+    typename Ops::V bytes[Batches];
+    typename Ops::V shifts[Batches];
+    typename Ops::V back_shifts[Batches];
+
+    explicit GroupLayout(unsigned bits_per_codeword) {
+        for (int batch = 0; batch < Batches; batch++) {
+            alignas(64) uint64_t bytes_offsets[Ops::kLanes];
+            alignas(64) uint64_t bits_offsets[Ops::kLanes];
+            alignas(64) uint64_t back_offsets[Ops::kLanes];
+            for (int lane = 0; lane < Ops::kLanes; lane++) {
+                uint64_t pos = (uint64_t) (batch * Ops::kLanes + lane) * bits_per_codeword;
+                bytes_offsets[lane] = pos / CHAR_BIT;
+                bits_offsets[lane] = pos % CHAR_BIT;
+                back_offsets[lane] = 64 - pos % CHAR_BIT;
+            }
+            bytes[batch] = Ops::Load(bytes_offsets);
+            shifts[batch] = Ops::Load(bits_offsets);
+            back_shifts[batch] = Ops::Load(back_offsets);
+        }
+    }
+};
+
+// Loads 64-bit value of every lane from the bit offset of layout plus limb * 64
+template<class Ops, int Batches>
+typename Ops::V LoadLanes(const uint8_t* base, const GroupLayout<Ops, Batches>& layout, int batch, int limb,
+                          unsigned bits) {
+    auto offsets = Ops::Add(layout.bytes[batch], Ops::Set1(limb * sizeof(uint64_t)));
+    auto value = Ops::Sllv(Ops::Bswap(Ops::Gather(base, offsets)), layout.shifts[batch]);
+    if (bits + CHAR_BIT - 1 > 64) {
+        // Last bits are in the next byte, shift by 64 gives zero for lanes starting from the whole byte
+        offsets = Ops::Add(offsets, Ops::Set1(sizeof(uint64_t)));
+        value = Ops::Or(value, Ops::Srlv(Ops::Bswap(Ops::Gather(base, offsets)), layout.back_shifts[batch]));
+    }
+    if (bits == 64) return value;
+    return Ops::And(value, Ops::Set1(~(~0ull >> bits)));
+}
+
+// Data bits, control bits and their parity masks broadcast to vectors
+template<class Ops>
+struct VectorCode {
+    typename Ops::V piece_masks[MAX_CODE_PIECES];
+    typename Ops::V parity_masks[MAX_EXTRA_BITS][MAX_CODE_LIMBS];
+    typename Ops::V top_bit;
+    unsigned fold_width;
+
+    explicit VectorCode(const HammingCode& code) {
+        for (uint8_t i = 0; i < code.pieces_count; i++) {
+            piece_masks[i] = Ops::Set1(code.pieces[i].mask);
+        }
+        for (uint8_t bit = 0; bit < code.extra_bits; bit++) {
+            for (uint8_t limb = 0; limb < code.code_limbs; limb++) {
+                parity_masks[bit][limb] = Ops::Set1(code.parity_masks[bit][limb]);
+            }
+        }
+        top_bit = Ops::Set1(1ull << 63);
+        fold_width = std::min<unsigned>(code.length, 64);
+    }
+
+    // Parity of positions checked by control bit, in the highest bit of lanes
+    template<int CodeLimbs>
+    typename Ops::V Parity(const typename Ops::V (&bits)[CodeLimbs], uint8_t bit) const {
+        auto covered = Ops::And(bits[0], parity_masks[bit][0]);
+        for (int i = 1; i < CodeLimbs; i++) {
+            covered = Ops::Xor(covered, Ops::And(bits[i], parity_masks[bit][i]));
+        }
+        return Ops::And(FoldParity<Ops>(covered, CodeLimbs == 1 ? fold_width : 64), top_bit);
+    }
+};
+
+template<class Ops, int DataLimbs, int CodeLimbs>
+uint64_t EncodeGroupsImpl(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups,
+                          uint8_t* out) {
+    using V = typename Ops::V;
+    constexpr int kBatches = CHAR_BIT / Ops::kLanes;
+    const size_t slack = sizeof(uint64_t) * (DataLimbs + 1);
+    if (in_size < slack) return 0;
+    groups = std::min<uint64_t>(groups, (in_size - slack) / code.word);
+
+    const GroupLayout<Ops, kBatches> layout(code.word);
+    const VectorCode<Ops> vector_code(code);
+    BitPacker output(out);
+    alignas(64) uint64_t lanes[CodeLimbs][Ops::kLanes];
+    for (uint64_t group = 0; group < groups; group++) {
+        const uint8_t* base = in + group * code.word;
+        for (int batch = 0; batch < kBatches; batch++) {
+            V data[DataLimbs];
+            V bits[CodeLimbs];
+            for (int i = 0; i < DataLimbs; i++) {
+                data[i] = LoadLanes(base, layout, batch, i, LimbBits(code.word, i));
+            }
+            for (int i = 0; i < CodeLimbs; i++) {
+                bits[i] = Ops::Zero();
+            }
+
+            // Placing data bits between control bits
+            for (uint8_t i = 0; i < code.pieces_count; i++) {
+                const auto& piece = code.pieces[i];
+                auto value = Ops::And(data[piece.data_limb], vector_code.piece_masks[i]);
+                value = Ops::Sll(Ops::Srl(value, piece.right), piece.left);
+                bits[piece.code_limb] = Ops::Or(bits[piece.code_limb], value);
+            }
+
+            // Control bits are zeros yet, so parity of checked positions is the control bit itself
+            for (uint8_t bit = 0; bit < code.extra_bits; bit++) {
+                uint32_t pos = (1u << bit) - 1;
+                auto parity = Ops::Srl(vector_code.Parity(bits, bit), pos % 64);
+                bits[pos / 64] = Ops::Or(bits[pos / 64], parity);
+            }
+
+            for (int i = 0; i < CodeLimbs; i++) {
+                Ops::Store(lanes[i], bits[i]);
+            }
+            for (int lane = 0; lane < Ops::kLanes; lane++) {
+                for (int i = 0; i < CodeLimbs; i++) {
+                    output.Put(lanes[i][lane], LimbBits(code.length, i));
+                }
+            }
+        }
+    }
+    output.Flush();
+    return groups;
+}
+
+template<class Ops, int DataLimbs, int CodeLimbs>
+uint64_t DecodeGroupsImpl(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups,
+                          uint8_t* out) {
+    using V = typename Ops::V;
+    constexpr int kBatches = CHAR_BIT / Ops::kLanes;
+    const size_t slack = sizeof(uint64_t) * (CodeLimbs + 1);
+    if (in_size < slack) return 0;
+    groups = std::min<uint64_t>(groups, (in_size - slack) / code.length);
+
+    const GroupLayout<Ops, kBatches> layout(code.length);
+    const VectorCode<Ops> vector_code(code);
+    BitPacker output(out);
+    alignas(64) uint64_t lanes[DataLimbs][Ops::kLanes];
+    for (uint64_t group = 0; group < groups; group++) {
+        const uint8_t* base = in + group * code.length;
+        for (int batch = 0; batch < kBatches; batch++) {
+            V bits[CodeLimbs];
+            V data[DataLimbs];
+            for (int i = 0; i < CodeLimbs; i++) {
+                bits[i] = LoadLanes(base, layout, batch, i, LimbBits(code.length, i));
+            }
+            for (int i = 0; i < DataLimbs; i++) {
+                data[i] = Ops::Zero();
+            }
+
+            // Gathering data bits from between control bits
+            for (uint8_t i = 0; i < code.pieces_count; i++) {
+                const auto& piece = code.pieces[i];
+                auto value = Ops::Sll(Ops::Srl(bits[piece.code_limb], piece.left), piece.right);
+                data[piece.data_limb] = Ops::Or(data[piece.data_limb], Ops::And(value, vector_code.piece_masks[i]));
+            }
+
+            // Syndrome is collected from parities, lanes with errors take their correction from table
+            auto syndrome = Ops::Zero();
+            for (uint8_t bit = 0; bit < code.extra_bits; bit++) {
+                syndrome = Ops::Or(syndrome, Ops::Srl(vector_code.Parity(bits, bit), 63 - bit));
+            }
+            if (!Ops::IsZero(syndrome)) {
+                for (int i = 0; i < DataLimbs; i++) {
+                    data[i] = Ops::Xor(data[i], Ops::GatherTable(code.corrections[i], syndrome));
+                }
+            }
+
+            for (int i = 0; i < DataLimbs; i++) {
+                Ops::Store(lanes[i], data[i]);
+            }
+            for (int lane = 0; lane < Ops::kLanes; lane++) {
+                for (int i = 0; i < DataLimbs; i++) {
+                    output.Put(lanes[i][lane], LimbBits(code.word, i));
+                }
+            }
+        }
+    }
+    output.Flush();
+    return groups;
+}
+
+// Only syndromes of codewords are counted, lanes with errors are rare and are classified by scalar code
+template<class Ops, int CodeLimbs>
+uint64_t CheckGroupsImpl(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups,
+                         CodewordErrors& errors, std::vector<uint64_t>* wrong_bits) {
+    using V = typename Ops::V;
+    constexpr int kBatches = CHAR_BIT / Ops::kLanes;
+    const size_t slack = sizeof(uint64_t) * (CodeLimbs + 1);
+    if (in_size < slack) return 0;
+    groups = std::min<uint64_t>(groups, (in_size - slack) / code.length);
+
+    const GroupLayout<Ops, kBatches> layout(code.length);
+    const VectorCode<Ops> vector_code(code);
+    alignas(64) uint64_t syndromes[Ops::kLanes];
+    for (uint64_t group = 0; group < groups; group++) {
+        const uint8_t* base = in + group * code.length;
+        for (int batch = 0; batch < kBatches; batch++) {
+            V bits[CodeLimbs];
+            for (int i = 0; i < CodeLimbs; i++) {
+                bits[i] = LoadLanes(base, layout, batch, i, LimbBits(code.length, i));
+            }
+            auto syndrome = Ops::Zero();
+            for (uint8_t bit = 0; bit < code.extra_bits; bit++) {
+                syndrome = Ops::Or(syndrome, Ops::Srl(vector_code.Parity(bits, bit), 63 - bit));
+            }
+            if (Ops::IsZero(syndrome)) continue;
+            Ops::Store(syndromes, syndrome);
+            for (int lane = 0; lane < Ops::kLanes; lane++) {
+                if (syndromes[lane] == 0) continue;
+                if (syndromes[lane] > code.length) {
+                    errors.uncorrectable++;
+                    continue;
+                }
+                errors.corrected++;
+                uint64_t codeword = group * CHAR_BIT + batch * Ops::kLanes + lane;
+                if (wrong_bits) wrong_bits->push_back(codeword * code.length + syndromes[lane] - 1);
+            }
+        }
+    }
+    return groups;
+}
+
+// Codes with vector kernels: 26 and 57 take one lane, 120 takes two
+template<class Ops>
+uint64_t EncodeGroupsVector(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups,
+                            uint8_t* out) {
+    if (code.code_limbs == 1) return EncodeGroupsImpl<Ops, 1, 1>(code, in, in_size, groups, out);
+    return EncodeGroupsImpl<Ops, 2, 2>(code, in, in_size, groups, out);
+}
+
+template<class Ops>
+uint64_t CheckGroupsVector(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups,
+                           CodewordErrors& errors, std::vector<uint64_t>* wrong_bits) {
+    if (code.code_limbs == 1) return CheckGroupsImpl<Ops, 1>(code, in, in_size, groups, errors, wrong_bits);
+    return CheckGroupsImpl<Ops, 2>(code, in, in_size, groups, errors, wrong_bits);
+}
+
+template<class Ops>
+uint64_t DecodeGroupsVector(const HammingCode& code, const uint8_t* in, size_t in_size, uint64_t groups,
+                            uint8_t* out) {
+    if (code.code_limbs == 1) return DecodeGroupsImpl<Ops, 1, 1>(code, in, in_size, groups, out);
+    return DecodeGroupsImpl<Ops, 2, 2>(code, in, in_size, groups, out);
+}
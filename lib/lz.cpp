@@ -0,0 +1,146 @@
+#include "lz.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kMaxOffset = UINT16_MAX;
+constexpr size_t kSizeMask = 15;
+constexpr int kHashBits = 16;
+// Step of search grows by one after every 64 positions without match, so incompressible data is skipped fast
+constexpr int kSkipShift = 6;
+
+uint32_t Load32(const char* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint64_t Load64(const char* data) {
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+} // namespace
+
+size_t LzCompress(const char* data, size_t size, char* compressed, size_t capacity) {
+    // Positions of the last sequences by their hashes, 0 is empty, so positions are stored plus one
+    thread_local std::vector<uint32_t> table;
+    table.assign(1 << kHashBits, 0);
+    size_t written = 0;
+
+    auto write_size = [&](size_t rest) {
+        for (; rest >= UINT8_MAX; rest -= UINT8_MAX) {
+            compressed[written++] = (char) UINT8_MAX;
+        }
+        compressed[written++] = (char) rest;
+    };
+    // Sequence of literals from anchor and match of match_size bytes at offset (match_size 0 is the last sequence)
+    auto write_sequence = [&](const char* literals, size_t literals_size, size_t offset, size_t match_size) {
+        size_t most_size = 1 + literals_size / UINT8_MAX + 1 + literals_size + 2 + match_size / UINT8_MAX + 1;
+        if (capacity - written < most_size) return false;
+        size_t token_match = match_size ? match_size - kMinMatch : 0;
+        compressed[written++] = (char) ((std::min(literals_size, kSizeMask) << 4) | std::min(token_match, kSizeMask));
+        if (literals_size >= kSizeMask) write_size(literals_size - kSizeMask);
+        std::memcpy(compressed + written, literals, literals_size);
+        written += literals_size;
+        if (match_size == 0) return true;
+        compressed[written++] = (char) (offset & 0xFF);
+        compressed[written++] = (char) (offset >> 8);
+        if (token_match >= kSizeMask) write_size(token_match - kSizeMask);
+        return true;
+    };
+
+    size_t anchor = 0;
+    size_t position = 0;
+    size_t misses = 0;
+    while (size >= kMinMatch && position <= size - kMinMatch) {
+        uint32_t sequence = Load32(data + position);
+        uint32_t& entry = table[Hash(sequence)];
+        size_t candidate = entry;
+        entry = (uint32_t) position + 1;
+        if (candidate == 0 || position - (candidate - 1) > kMaxOffset || Load32(data + candidate - 1) != sequence) {
+            position += (misses++ >> kSkipShift) + 1;
+            continue;
+        }
+        size_t match = candidate - 1;
+        // Match is extended backwards over literals and forwards to the end of data
+        while (position > anchor && match > 0 && data[position - 1] == data[match - 1]) {
+            position--;
+            match--;
+        }
+        // The first differing byte of 8 is found by the lowest differing bit (data is little-endian)
+        size_t match_size = kMinMatch;
+        while (position + match_size + sizeof(uint64_t) <= size) {
+            uint64_t difference = Load64(data + position + match_size) ^ Load64(data + match + match_size);
+            if (difference) break;
+            match_size += sizeof(uint64_t);
+        }
+        if (position + match_size + sizeof(uint64_t) <= size) {
+            uint64_t difference = Load64(data + position + match_size) ^ Load64(data + match + match_size);
+            match_size += std::countr_zero(difference) / 8;
+        } else {
+            while (position + match_size < size && data[position + match_size] == data[match + match_size]) {
+                match_size++;
+            }
+        }
+        if (!write_sequence(data + anchor, position - anchor, position - match, match_size)) return 0;
+        position += match_size;
+        anchor = position;
+        misses = 0;
+    }
+    if (!write_sequence(data + anchor, size - anchor, 0, 0)) return 0;
+    return written;
+}
+
+void LzDecompress(const char* compressed, size_t compressed_size, char* data, size_t size) {
+    size_t read = 0;
+    size_t written = 0;
+    auto damaged = []() { throw std::runtime_error("Compressed data is damaged"); };
+    auto read_size = [&](size_t value) {
+        if (value != kSizeMask) return value;
+        uint8_t part;
+        do {
+            if (read == compressed_size) damaged();
+            part = (uint8_t) compressed[read++];
+            value += part;
+        } while (part == UINT8_MAX);
+        return value;
+    };
+
+    while (read < compressed_size) {
+        auto token = (uint8_t) compressed[read++];
+        size_t literals_size = read_size(token >> 4);
+        if (literals_size > compressed_size - read || literals_size > size - written) damaged();
+        std::memcpy(data + written, compressed + read, literals_size);
+        read += literals_size;
+        written += literals_size;
+        if (read == compressed_size) break;
+
+        if (compressed_size - read < 2) damaged();
+        size_t offset = (uint8_t) compressed[read] | ((size_t) (uint8_t) compressed[read + 1] << 8);
+        read += 2;
+        size_t match_size = read_size(token & kSizeMask) + kMinMatch;
+        if (offset == 0 || offset > written || match_size > size - written) damaged();
+        // Match may overlap bytes it writes, then it repeats them
+        if (offset >= match_size) {
+            std::memcpy(data + written, data + written - offset, match_size);
+        } else {
+            for (size_t i = 0; i < match_size; i++) {
+                data[written + i] = data[written - offset + i];
+            }
+        }
+        written += match_size;
+    }
+    if (written != size) damaged();
+}
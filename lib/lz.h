@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+/*
+ * LZ77 compression of independent chunks (format of LZ4 blocks): sequences [token][literals_size][literals]
+ * [match_offset][match_size], token - 1B (upper 4 bits are size of literals, lower 4 bits are size of match minus 4,
+ * 15 is continued by bytes of size added while they are 255), match_offset - 2B. The last sequence has only literals
+ */
+
+// Compressed data is written to compressed, returns its size or 0 if it is larger than capacity
+size_t LzCompress(const char* data, size_t size, char* compressed, size_t capacity);
+
+// Decompresses chunk of exactly size bytes, throws if compressed data is damaged
+void LzDecompress(const char* compressed, size_t compressed_size, char* data, size_t size);
@@ -0,0 +1,114 @@
+#include "lib/hamming.h"
+
+#include <algorithm>
+#include <climits>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Vector kernels must give the same bytes as scalar code: every word is encoded and decoded (with one wrong bit
+ * in many groups) by every kernel supported by CPU, in packed and interleaved layouts.
+ * Data is whole groups and incomplete one, so both grouped and remaining codewords are coded
+ */
+namespace {
+
+const CodecKernel kKernels[] = {CodecKernel::Scalar, CodecKernel::Avx2, CodecKernel::Avx512};
+
+std::vector<char> Encode(uint16_t word, BlockLayout layout, const std::vector<char>& data) {
+    std::vector<char> coded;
+    HammingEncoder encoder(word, layout);
+    // Odd chunks make encoder keep incomplete groups between calls
+    for (size_t begin = 0; begin < data.size(); begin += 1000) {
+        encoder.Update(data.data() + begin, std::min<size_t>(1000, data.size() - begin), coded);
+    }
+    encoder.Finish(coded);
+    return coded;
+}
+
+std::vector<char> Decode(uint16_t word, BlockLayout layout, const std::vector<char>& coded, uint64_t data_bytes) {
+    std::vector<char> data;
+    HammingDecoder(word, data_bytes, layout).Update(coded.data(), coded.size(), data);
+    return data;
+}
+
+// Flips one bit in every window of whole groups, so no codeword has two wrong bits. Slice mixes bits of its
+// 64 codewords, so interleaved block gets one wrong bit per slice
+uint64_t InjectErrors(uint16_t word, BlockLayout layout, uint64_t data_bytes, std::vector<char>& coded,
+                      std::mt19937_64& random) {
+    const uint64_t group_bytes = CodewordLength(word);
+    const uint64_t window_bytes = layout == BlockLayout::Interleaved ? SLICE_GROUPS * group_bytes : group_bytes;
+    const uint64_t groups_bytes = data_bytes / GroupDataBytes(word) * group_bytes;
+    uint64_t flipped = 0;
+    for (uint64_t window = 0; window + window_bytes <= groups_bytes; window += window_bytes) {
+        uint64_t bit = random() % (window_bytes * CHAR_BIT);
+        coded[window + bit / CHAR_BIT] ^= (char) (1 << (bit % CHAR_BIT));
+        flipped++;
+    }
+    return flipped;
+}
+
+bool Check(bool passed, uint16_t word, BlockLayout layout, CodecKernel kernel, const std::string& what) {
+    if (!passed)
+        std::cout << WordName(word) << (layout == BlockLayout::Interleaved ? " interleaved" : " packed") << ", "
+                  << CodecKernelName(kernel) << ": " << what << std::endl;
+    return passed;
+}
+
+} // namespace
+
+int main() {
+    std::vector<uint16_t> words;
+    for (uint16_t word = 1; word <= UINT8_MAX; word++) {
+        words.push_back(word);
+    }
+    words.push_back(SECDED_72_64);
+    words.push_back(SECDED_137_128);
+
+    std::mt19937_64 random(20240611);
+    bool passed = true;
+    uint64_t checked = 0;
+    for (uint16_t word: words) {
+        for (BlockLayout layout: {BlockLayout::Packed, BlockLayout::Interleaved}) {
+            if (layout == BlockLayout::Interleaved && (word & ALIGNED_PROFILE_FLAG)) continue;
+            // Enough groups for slices after the packed prefix of interleaved block
+            uint64_t prefix_groups = layout == BlockLayout::Interleaved ? SliceBegin(word, layout) : 0;
+            uint64_t data_bytes = (prefix_groups + 5 * SLICE_GROUPS) * GroupDataBytes(word) +
+                                  GroupDataBytes(word) / 2 + 1;
+            std::vector<char> data(data_bytes);
+            for (auto& byte: data) {
+                byte = (char) random();
+            }
+
+            SetCodecKernel(CodecKernel::Scalar);
+            auto coded = Encode(word, layout, data);
+            auto damaged = coded;
+            uint64_t flipped = InjectErrors(word, layout, data_bytes, damaged, random);
+            for (CodecKernel kernel: kKernels) {
+                if (!CodecKernelSupported(kernel)) continue;
+                SetCodecKernel(kernel);
+                passed &= Check(Encode(word, layout, data) == coded, word, layout, kernel,
+                                "coded data differs from scalar");
+                passed &= Check(Decode(word, layout, coded, data_bytes) == data, word, layout, kernel,
+                                "decoded data differs");
+                passed &= Check(Decode(word, layout, damaged, data_bytes) == data, word, layout, kernel,
+                                "wrong bits are not corrected");
+                CodewordErrors errors;
+                CheckBlockCodewords(GetHammingCode(word), reinterpret_cast<const uint8_t*>(damaged.data()),
+                                    data_bytes, 0, SliceBegin(word, layout), errors);
+                passed &= Check(errors.corrected == flipped && errors.uncorrectable == 0, word, layout, kernel,
+                                "errors are counted as " + std::to_string(errors.corrected) + " corrected and " +
+                                std::to_string(errors.uncorrectable) + " uncorrectable codewords, not " +
+                                std::to_string(flipped));
+            }
+            checked++;
+        }
+    }
+    for (CodecKernel kernel: kKernels) {
+        std::cout << CodecKernelName(kernel) << (CodecKernelSupported(kernel) ? "" : " (not supported by CPU)")
+                  << std::endl;
+    }
+    std::cout << "Checked words and layouts: " << checked << std::endl;
+    return passed ? 0 : 1;
+}
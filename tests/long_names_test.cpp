@@ -0,0 +1,159 @@
+#include "lib/bitstream.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Files with long names go through Haf read from pipe (headers are decoded by prefixes of their blocks) and
+ * through marking them deleted (their headers are coded again), also as linked files of Haf with dedup.
+ * Headers of interleaved blocks must fit into their packed prefix, so Haf with longer names is not created
+ * and its output is kept
+ */
+namespace {
+
+namespace fs = std::filesystem;
+
+const fs::path kRoot = fs::temp_directory_path() / "hamarc_long_names_test";
+
+std::string ReadWhole(const fs::path& path) {
+    std::ifstream input(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+}
+
+void WriteWhole(const fs::path& path, const std::string& data) {
+    fs::create_directories(path.parent_path());
+    std::ofstream(path, std::ios::binary) << data;
+}
+
+// Name of name_size bytes in directory src: "src/aaa.../bbb.../ccc..." (parts of directories are shorter than 256)
+std::string LongName(size_t name_size, char last) {
+    std::string name = "src/" + std::string(100, 'a') + "/" + std::string(100, 'b') + "/";
+    return name + std::string(name_size - name.size() - 1, 'c') + last;
+}
+
+// Extracts Haf written to FIFO in directory out, as Haf read from pipe
+void ExtractFromPipe(const fs::path& haf, const fs::path& out) {
+    fs::path pipe = kRoot / "pipe.haf";
+    fs::remove(pipe);
+    if (mkfifo(pipe.c_str(), 0600) != 0) throw std::runtime_error("Can't make FIFO " + pipe.string());
+    std::string data = ReadWhole(haf);
+    std::thread writer([&]() {
+        int fd = open(pipe.c_str(), O_WRONLY);
+        for (size_t written = 0; fd >= 0 && written < data.size();) {
+            ssize_t part = write(fd, data.data() + written, data.size() - written);
+            if (part <= 0) break;
+            written += part;
+        }
+        if (fd >= 0) close(fd);
+    });
+    fs::path current = fs::current_path();
+    fs::create_directories(out);
+    fs::current_path(out);
+    try {
+        ExtractHaf(pipe, "");
+    } catch (...) {
+        fs::current_path(current);
+        writer.join();
+        throw;
+    }
+    fs::current_path(current);
+    writer.join();
+}
+
+bool Check(bool passed, const std::string& what) {
+    if (!passed) std::cout << "FAILED: " << what << std::endl;
+    return passed;
+}
+
+bool RoundTrip(uint16_t word, BlockLayout layout, size_t name_size, bool dedup) {
+    const std::string what = WordName(word) + (layout == BlockLayout::Interleaved ? " interleaved" : " packed") +
+                             (dedup ? " with dedup" : "") + ", name of " + std::to_string(name_size) + "B";
+    fs::remove_all(kRoot);
+    std::mt19937_64 random(name_size);
+    std::string data(5000, '\0');
+    for (auto& byte: data) {
+        byte = (char) random();
+    }
+    std::vector<std::pair<std::string, std::string>> files = {{LongName(name_size, 'x'), data},
+                                                              {"src/small", data.substr(0, 3000)}};
+    // Linked file has link after its long name
+    if (dedup) files.emplace_back(LongName(name_size, 'y'), data);
+    for (const auto& [name, content]: files) {
+        WriteWhole(kRoot / name, content);
+    }
+
+    fs::current_path(kRoot);
+    fs::path haf = kRoot / "a.haf";
+    std::vector<std::string> args = {"src"};
+    CreateHaf(haf, args, word, "", 1, layout, dedup);
+    bool passed = true;
+    ExtractFromPipe(haf, kRoot / "pipe_out");
+    for (const auto& [name, content]: files) {
+        passed &= Check(ReadWhole(kRoot / "pipe_out" / name) == content, what + ": " + name + " from pipe");
+    }
+
+    // Linked file takes data of deleted file, it is kept from pipe in temporary file
+    const size_t deleted_file = 0;
+    std::vector<std::string> deleted = {files[deleted_file].first};
+    DeleteFilesFromHaf(haf, deleted, true);
+    auto errors = VerifyHaf(haf);
+    passed &= Check(errors.corrected == 0 && errors.uncorrectable == 0,
+                    what + ": Haf has " + std::to_string(errors.corrected) + " corrected codewords after file is "
+                    "marked deleted");
+    ExtractFromPipe(haf, kRoot / "deleted_out");
+    for (size_t i = 0; i < files.size(); i++) {
+        fs::path extracted = kRoot / "deleted_out" / files[i].first;
+        if (i == deleted_file) passed &= Check(!fs::exists(extracted), what + ": deleted file is extracted");
+        else passed &= Check(ReadWhole(extracted) == files[i].second, what + ": " + files[i].first + " with deleted");
+    }
+    return passed;
+}
+
+// Haf with too long name is not created, file at its place is not changed
+bool Rejected(uint16_t word, size_t name_size) {
+    fs::remove_all(kRoot);
+    WriteWhole(kRoot / LongName(name_size, 'x'), "data");
+    fs::current_path(kRoot);
+    fs::path haf = kRoot / "a.haf";
+    WriteWhole(haf, "kept");
+    std::vector<std::string> args = {"src"};
+    try {
+        CreateHaf(haf, args, word, "", 1, BlockLayout::Interleaved);
+    } catch (const std::runtime_error& error) {
+        std::cout << error.what() << std::endl;
+        return Check(ReadWhole(haf) == "kept", "output is changed by rejected Haf");
+    }
+    return Check(false, "name of " + std::to_string(name_size) + "B is included into interleaved Haf");
+}
+
+} // namespace
+
+int main() {
+    bool passed = true;
+    try {
+        for (uint16_t word: {1, 4, 11, 57, 255}) {
+            for (bool dedup: {false, true}) {
+                passed &= RoundTrip(word, BlockLayout::Packed, 300, dedup);
+                passed &= RoundTrip(word, BlockLayout::Interleaved, UINT8_MAX, dedup);
+            }
+            passed &= Rejected(word, 300);
+        }
+        passed &= RoundTrip(SECDED_72_64, BlockLayout::Packed, 300, true);
+    } catch (const std::exception& error) {
+        std::cout << "FAILED: " << error.what() << std::endl;
+        passed = false;
+    }
+    fs::current_path(fs::temp_directory_path());
+    fs::remove_all(kRoot);
+    return passed ? 0 : 1;
+}